@@ -3,10 +3,29 @@
 #include <Windows.h>
 #include <assert.h>
 #include <stdint.h>
+#include <limits.h>
 #include <iostream>
 #include <utility>
 #include <string>
+#include <string_view>
+#include <algorithm>
 #include <memory>
+#include <vector>
+#include <functional>
+#include <chrono>
+#include <cstddef>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define WINTERM_SSE2
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 
 namespace term {
@@ -37,29 +56,158 @@ enum : uint16_t {
 };
 
 enum option {
-  cursor,       // show/hide the cursor
-  highlighting  // enable/hide text highlighting
+  cursor,             // show/hide the cursor
+  highlighting,       // enable/hide text highlighting
+  preserve_on_resize, // keep the backbuffer contents when resizing
+  resizable,          // let the user resize the console window
+  vt_output,          // write only what changed as vt sequences, one write per frame
+  bandwidth_aware     // with vt_output, write less when the output can't keep up
 };
 
+// a foreground and background color, packed the same way the console stores
+// them so it can be written to a cell as is
 struct attribute {
-  attribute(uint16_t const f, uint16_t const b = black)
-    : foreground(f), background(b), _other(0) {}
+  constexpr attribute(uint16_t const f, uint16_t const b = black)
+    : value((uint16_t)((f & 0xF) | (b & 0xF) << 4)) {}
+
+  constexpr uint16_t foreground() const { return value & 0xF; }
+  constexpr uint16_t background() const { return (uint16_t)(value >> 4 & 0xF); }
+
+  // change one of the colors, keeping the other
+  constexpr void foreground(uint16_t const f) {
+    value = (uint16_t)((value & 0xFFF0) | (f & 0xF));
+  }
+  constexpr void background(uint16_t const b) {
+    value = (uint16_t)((value & 0xFF0F) | (b & 0xF) << 4);
+  }
 
-  uint16_t foreground : 4;
-  uint16_t background : 4;
-  uint16_t _other : 8;
+  // the foreground in the low 4 bits and the background in the next 4
+  // (CHAR_INFO::Attributes)
+  uint16_t value;
 };
 static_assert(sizeof(attribute) == 2, "attribute is wrong size");
 
+struct rect {
+  int x = 0, y = 0, width = 0, height = 0;
+};
+
+// flags for blit()
+enum flip {
+  flip_none       = 0,
+  flip_horizontal = 1 << 0,
+  flip_vertical   = 1 << 1
+};
+
+// an off-screen block of cells (a sprite, for example) that can be drawn
+// to the backbuffer with blit()
+class surface {
+public:
+  explicit surface(vec2 const& size)
+    : size_(size), cells_(std::make_unique<CHAR_INFO[]>((size_t)size.x * size.y)) {}
+
+  // the size of the surface (measured in characters)
+  vec2 size() const { return size_; }
+
+  // the cells of the surface, row by row
+  CHAR_INFO* cells() { return cells_.get(); }
+  CHAR_INFO const* cells() const { return cells_.get(); }
+
+  // set a single cell
+  void character(vec2 const& position, attribute attrib, wchar_t const c) {
+    assert(position.x >= 0 && position.x < size_.x);
+    assert(position.y >= 0 && position.y < size_.y);
+
+    cells_[position.x + (size_t)position.y * size_.x] = {
+      c, attrib.value
+    };
+  }
+
+  // set every cell
+  void fill(attribute attrib, wchar_t const c) {
+    std::fill(cells_.get(), cells_.get() + (size_t)size_.x * size_.y,
+      CHAR_INFO{ c, attrib.value });
+  }
+
+private:
+  vec2 size_;
+  std::unique_ptr<CHAR_INFO[]> cells_;
+};
+
+namespace impl {
+struct context_state;
+}
+
+// everything needed to render to a console, so that a single process can
+// drive more than one of them (or render without any console at all)
+// the free functions render to the context that is current on the calling
+// thread, which is the process console unless a context_scope says otherwise
+class context {
+public:
+  // render to a console screen buffer (CreateConsoleScreenBuffer(), or the
+  // handles of a pseudo console)
+  // the size is taken from the screen buffer, 80x25 if it isn't one
+  context(HANDLE out_handle, HANDLE in_handle);
+
+  // render to any handle with the given size, for handles that aren't
+  // console screen buffers (pipes, files, the pipes of a pseudo console)
+  // which only make sense with vt output
+  context(HANDLE out_handle, HANDLE in_handle, vec2 const& size);
+
+  // render to a backbuffer only, flushing just runs the flush hooks
+  explicit context(vec2 const& size);
+
+  ~context();
+
+  context(context const&) = delete;
+  context& operator=(context const&) = delete;
+
+private:
+  friend class context_scope;
+
+  std::unique_ptr<impl::context_state> state_;
+};
+
+// makes a context current on the calling thread for as long as it's alive
+// every thread can have a different context current at the same time
+class context_scope {
+public:
+  explicit context_scope(context& ctx);
+  ~context_scope();
+
+  context_scope(context_scope const&) = delete;
+  context_scope& operator=(context_scope const&) = delete;
+
+private:
+  impl::context_state* previous_;
+};
+
 // setup the console
 void initialize();
 
 // write the backbuffer to the console window
 void flush();
 
+// finish a frame without writing anything to the console (because nothing
+// changed, for example), resizes and the frame arena are still handled
+void skip_frame();
+
+// whether flushing would write anything: the backbuffer is different from
+// the last frame that was flushed, or bandwidth_aware output still has cells
+// that it put off or wrote with reduced colors
+bool needs_flush();
+
 // resize the console window and clear the backbuffer
+// (the contents are kept instead if preserve_on_resize is enabled)
 void size(vec2 const& size);
 
+// resize the console window after the next flush
+// multiple requests in the same frame only resize once
+void request_size(vec2 const& size);
+
+// called after the backbuffer was resized between frames, either because
+// of request_size() or because the user resized the window (see resizable)
+void on_resize(std::function<void(vec2 const& size)> callback);
+
 // get the size of the console (measured in characters)
 inline vec2 size();
 
@@ -106,184 +254,1868 @@ void vline(int xpos, attribute attrib, wchar_t c);
 // render a single character to the console
 void character(vec2 const& position, attribute attrib, wchar_t c);
 
+// copy a block of cells from a surface to the console
+// flags is any combination of flip values
+void blit(surface const& src, rect const& src_rect,
+    vec2 const& position, int flags = flip_none);
+
+// copy a block of cells from a surface to the console, skipping every cell
+// that is identical to transparent
+void blit(surface const& src, rect const& src_rect, vec2 const& position,
+    CHAR_INFO const& transparent, int flags = flip_none);
+
 // render a string to the console
 // returns the start and end position of the string
 template <typename ...Args>
 std::pair<int, int> string(vec2 const& position, 
     attribute attrib, wchar_t const* format, Args&& ...args);
 
-// render a horizontally centered string to the console
-// returns the start and end position of the string
-template <typename ...Args>
-std::pair<int, int> stringc(vec2 const& position, 
-    attribute attrib, wchar_t const* format, Args&& ...args);
+// render a horizontally centered string to the console
+// returns the start and end position of the string
+template <typename ...Args>
+std::pair<int, int> stringc(vec2 const& position, 
+    attribute attrib, wchar_t const* format, Args&& ...args);
+
+// the length of a string after formatting is applied
+template <typename ...Args>
+size_t string_len(wchar_t const* format, Args&& ...args);
+
+// render a wide string to the console (no printf-style formatting)
+// returns the start and end position of the string
+std::pair<int, int> string(vec2 const& position,
+    attribute attrib, std::wstring_view str);
+
+// render a horizontally centered wide string (no printf-style formatting)
+// returns the start and end position of the string
+std::pair<int, int> stringc(vec2 const& position,
+    attribute attrib, std::wstring_view str);
+
+// the length of a wide string after color formatting has been removed
+size_t string_len(std::wstring_view str);
+
+// render a utf-8 string to the console
+// returns the start and end position of the string
+template <typename ...Args>
+std::pair<int, int> string(vec2 const& position,
+    attribute attrib, char const* format, Args&& ...args);
+
+// render a utf-8 string to the console (no printf-style formatting)
+// returns the start and end position of the string
+std::pair<int, int> string(vec2 const& position,
+    attribute attrib, std::string_view str);
+
+// render a horizontally centered utf-8 string to the console
+// returns the start and end position of the string
+template <typename ...Args>
+std::pair<int, int> stringc(vec2 const& position,
+    attribute attrib, char const* format, Args&& ...args);
+
+// render a horizontally centered utf-8 string (no printf-style formatting)
+// returns the start and end position of the string
+std::pair<int, int> stringc(vec2 const& position,
+    attribute attrib, std::string_view str);
+
+// the length of a utf-8 string after formatting is applied
+template <typename ...Args>
+size_t string_len(char const* format, Args&& ...args);
+
+// the length of a utf-8 string after color formatting has been removed
+size_t string_len(std::string_view str);
+
+// get user input
+template <typename T>
+bool input(vec2 position, T& value);
+
+// called with the contents of the backbuffer every time it is flushed
+using flush_hook = std::function<void(CHAR_INFO const* cells, vec2 const& size)>;
+
+// register a function that gets called after every flush of the current
+// context
+// returns an id that can be passed to remove_flush_hook()
+int add_flush_hook(flush_hook hook);
+
+// unregister a flush hook, with the context it was added to current (ids
+// only mean something in that context)
+void remove_flush_hook(int id);
+
+// how the per-frame arena is being used
+struct arena_stats {
+  // heap allocations made by the arena so far
+  // this stops growing once frames settle on how much memory they need
+  size_t allocations = 0;
+
+  // bytes handed out since the last flush, and the most in a single frame
+  size_t bytes = 0,
+    peak = 0;
+};
+
+// get the per-frame arena usage
+arena_stats frame_arena_stats();
+
+// what flushing has written to the console (only counted with vt_output)
+struct output_stats {
+  size_t frames = 0;
+
+  // bytes written, the number of writes it took and how many of those
+  // didn't write everything they were given
+  size_t bytes = 0,
+    writes = 0,
+    partial_writes = 0;
+
+  // frames where not everything that changed could be written (with
+  // bandwidth_aware), and the runs of cells that had to wait because of it
+  size_t constrained_frames = 0,
+    deferred_spans = 0;
+
+  // how fast the output is being written (bytes per second)
+  double throughput = 0.0;
+
+  // rows that were checked for changes, and how many of those were skipped
+  // without comparing their cells because their hash matched the last frame
+  // (rows_skipped / rows is the skip ratio)
+  size_t rows = 0,
+    rows_skipped = 0;
+
+  // frames where rows that moved up or down (a log scrolling, for example)
+  // were scrolled on the terminal instead of being written again
+  size_t scrolls = 0;
+};
+
+// get what flushing has written to the console
+output_stats vt_output_stats();
+
+// split the screen into regions by importance, for bandwidth_aware output
+// when the output can't keep up, changes in regions with a higher priority
+// are written first and the rest wait for a later frame (by which point only
+// their latest contents get written), interval is how many frames a region
+// has to wait between updates while this is happening
+// returns an id that can be passed to remove_region() and focus_region()
+int add_region(rect const& area, int priority = 0, int interval = 1);
+
+// remove a region that was added with add_region()
+void remove_region(int id);
+
+// the region the user is interacting with, it always goes first and keeps
+// its colors while everything else is reduced to the 8 basic colors
+// (-1 for none)
+void focus_region(int id);
+
+// assume the output can only take this many bytes per second, instead of
+// measuring it (0 goes back to measuring)
+void bandwidth_limit(size_t bytes_per_second);
+
+// split finding what changed since the last frame (with vt_output) across
+// this many threads, for very large consoles (1 does it all on the thread
+// that flushes)
+void diff_threads(unsigned threads);
+
+// allocate memory that stays valid until the next flush
+void* frame_alloc(size_t size, size_t alignment = alignof(std::max_align_t));
+
+// format a string into memory that stays valid until the next flush
+// (meant for building strings that are only needed for a single frame)
+template <typename ...Args>
+std::wstring_view format(wchar_t const* format, Args&& ...args);
+
+// format a utf-8 string into memory that stays valid until the next flush
+template <typename ...Args>
+std::string_view format(char const* format, Args&& ...args);
+
+
+//
+//
+// implmentation below
+//
+//
+
+
+namespace impl {
+
+// a bump allocator for memory that only has to live until the end of a frame
+// the blocks it grew to in a frame are merged into a single block when it
+// is reset, so frames that need the same amount of memory never allocate
+class frame_arena {
+public:
+  // allocate memory, alignment has to be a power of two
+  void* allocate(size_t const size, size_t const alignment) {
+    if (!blocks_.empty()) {
+      auto const& last = blocks_.back();
+
+      auto const start = (uintptr_t)last.data.get();
+      auto const aligned = (start + offset_ + alignment - 1) & ~(uintptr_t)(alignment - 1);
+
+      if (aligned + size <= start + last.size) {
+        offset_ = aligned + size - start;
+        stats.bytes += size;
+        stats.peak = (std::max)(stats.peak, stats.bytes);
+        return (void*)aligned;
+      }
+    }
+
+    // doesn't fit, grow geometrically
+    auto const previous = blocks_.empty() ? 0 : blocks_.back().size;
+    grow((std::max)({ size + alignment, previous * 2, (size_t)4096 }));
+
+    return allocate(size, alignment);
+  }
+
+  // free everything that was allocated
+  void reset() {
+    if (blocks_.size() > 1) {
+      size_t total = 0;
+      for (auto const& each : blocks_)
+        total += each.size;
+
+      blocks_.clear();
+      grow(total);
+    }
+
+    offset_ = 0;
+    stats.bytes = 0;
+  }
+
+  arena_stats stats;
+
+private:
+  // start a new block
+  void grow(size_t const size) {
+    blocks_.push_back({ std::make_unique<uint8_t[]>(size), size });
+    offset_ = 0;
+    stats.allocations += 1;
+  }
+
+private:
+  struct block {
+    std::unique_ptr<uint8_t[]> data;
+    size_t size;
+  };
+
+  std::vector<block> blocks_;
+
+  // the offset into the last block
+  size_t offset_ = 0;
+};
+
+struct context_state;
+
+// stores the current state of the console
+inline context_state& state();
+
+// every character is written as a single 16-bit cell
+static_assert(sizeof(CHAR_INFO) == 4, "CHAR_INFO is wrong size");
+static_assert(sizeof(wchar_t) == 2, "wchar_t is wrong size");
+
+// index of the lowest set bit (mask must be non-zero)
+inline unsigned lowest_bit(unsigned const mask) {
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return (unsigned)index;
+#else
+  return (unsigned)__builtin_ctz(mask);
+#endif
+}
+
+// the number of leading characters that are plain ascii (no multi-byte 
+// sequences, color codes or escapes) and can be copied straight into cells
+inline size_t plain_run(char const* const str, size_t const size) {
+  size_t i = 0;
+
+#ifdef WINTERM_SSE2
+  auto const hash = _mm_set1_epi8('#'), backslash = _mm_set1_epi8('\\');
+
+  // 16 characters at a time
+  for (; i + 16 <= size; i += 16) {
+    auto const chars = _mm_loadu_si128((__m128i const*)(str + i));
+
+    // the sign bit is set for any byte that isn't plain ascii
+    auto const special = _mm_or_si128(chars, _mm_or_si128(
+      _mm_cmpeq_epi8(chars, hash), _mm_cmpeq_epi8(chars, backslash)));
+
+    if (auto const mask = (unsigned)_mm_movemask_epi8(special))
+      return i + lowest_bit(mask);
+  }
+#endif
+
+  for (; i < size; ++i) {
+    auto const c = (uint8_t)str[i];
+    if (c >= 0x80 || c == '#' || c == '\\')
+      break;
+  }
+
+  return i;
+}
+
+// the number of leading characters that aren't color codes or escapes
+inline size_t plain_run(wchar_t const* const str, size_t const size) {
+  size_t i = 0;
+
+#ifdef WINTERM_SSE2
+  auto const hash = _mm_set1_epi16(L'#'), backslash = _mm_set1_epi16(L'\\');
+
+  // 8 characters at a time
+  for (; i + 8 <= size; i += 8) {
+    auto const chars = _mm_loadu_si128((__m128i const*)(str + i));
+    auto const special = _mm_or_si128(
+      _mm_cmpeq_epi16(chars, hash), _mm_cmpeq_epi16(chars, backslash));
+
+    // two mask bits per character
+    if (auto const mask = (unsigned)_mm_movemask_epi8(special))
+      return i + lowest_bit(mask) / 2;
+  }
+#endif
+
+  for (; i < size; ++i) {
+    if (str[i] == L'#' || str[i] == L'\\')
+      break;
+  }
+
+  return i;
+}
+
+// write a run of plain ascii characters into the backbuffer
+inline void copy_run(CHAR_INFO* const dst, char const* const src,
+    size_t const count, uint16_t const attrib) {
+  size_t i = 0;
+
+#ifdef WINTERM_SSE2
+  auto const zero = _mm_setzero_si128();
+  auto const attribs = _mm_set1_epi16((short)attrib);
+
+  // 16 characters at a time, each CHAR_INFO is a (character, attribute) pair
+  for (; i + 16 <= count; i += 16) {
+    auto const chars = _mm_loadu_si128((__m128i const*)(src + i));
+    auto const lo = _mm_unpacklo_epi8(chars, zero);
+    auto const hi = _mm_unpackhi_epi8(chars, zero);
+
+    _mm_storeu_si128((__m128i*)(dst + i +  0), _mm_unpacklo_epi16(lo, attribs));
+    _mm_storeu_si128((__m128i*)(dst + i +  4), _mm_unpackhi_epi16(lo, attribs));
+    _mm_storeu_si128((__m128i*)(dst + i +  8), _mm_unpacklo_epi16(hi, attribs));
+    _mm_storeu_si128((__m128i*)(dst + i + 12), _mm_unpackhi_epi16(hi, attribs));
+  }
+#endif
+
+  for (; i < count; ++i)
+    dst[i] = { (wchar_t)(uint8_t)src[i], attrib };
+}
+
+// write a run of wide characters into the backbuffer
+inline void copy_run(CHAR_INFO* const dst, wchar_t const* const src,
+    size_t const count, uint16_t const attrib) {
+  size_t i = 0;
+
+#ifdef WINTERM_SSE2
+  auto const attribs = _mm_set1_epi16((short)attrib);
+
+  // 8 characters at a time
+  for (; i + 8 <= count; i += 8) {
+    auto const chars = _mm_loadu_si128((__m128i const*)(src + i));
+
+    _mm_storeu_si128((__m128i*)(dst + i + 0), _mm_unpacklo_epi16(chars, attribs));
+    _mm_storeu_si128((__m128i*)(dst + i + 4), _mm_unpackhi_epi16(chars, attribs));
+  }
+#endif
+
+  for (; i < count; ++i)
+    dst[i] = { src[i], attrib };
+}
+
+// decode a single utf-8 sequence and advance past it
+// invalid sequences (and anything that doesn't fit in a single cell) are
+// replaced with U+FFFD
+inline wchar_t decode(char const*& it, char const* const end) {
+  auto const lead = (uint8_t)*it++;
+  if (lead < 0x80)
+    return lead;
+
+  int extra = 0;
+  uint32_t codepoint = 0;
+
+  if ((lead & 0xE0) == 0xC0)
+    extra = 1, codepoint = lead & 0x1F;
+  else if ((lead & 0xF0) == 0xE0)
+    extra = 2, codepoint = lead & 0x0F;
+  else if ((lead & 0xF8) == 0xF0)
+    extra = 3, codepoint = lead & 0x07;
+  else
+    return 0xFFFD;
+
+  for (int i = 0; i < extra; ++i) {
+    if (it == end || ((uint8_t)*it & 0xC0) != 0x80)
+      return 0xFFFD;
+
+    codepoint = (codepoint << 6) | ((uint8_t)*it++ & 0x3F);
+  }
+
+  // overlong encodings, surrogates and anything outside of the bmp
+  static constexpr uint32_t minimum[] = { 0, 0x80, 0x800, 0x10000 };
+  if (codepoint < minimum[extra] || codepoint > 0xFFFF ||
+      (codepoint >= 0xD800 && codepoint <= 0xDFFF))
+    return 0xFFFD;
+
+  return (wchar_t)codepoint;
+}
+
+// wide characters are already a single cell each
+inline wchar_t decode(wchar_t const*& it, wchar_t const* const) {
+  return *it++;
+}
+
+// convert a string into cells in a single traversal, applying color codes
+// at most max_cells cells are written to dst, if measure is true the rest of 
+// the string is still traversed to find its true length
+// returns the number of cells written and the string's true length
+template <typename Char>
+inline std::pair<size_t, size_t> layout(std::basic_string_view<Char> const str,
+    attribute attrib, CHAR_INFO* const dst, size_t const max_cells,
+    bool const measure) {
+  auto it = str.data();
+  auto const end = it + str.size();
+
+  size_t length = 0;
+
+  while (it != end) {
+    // we reached the end and nobody cares about the rest
+    if (!measure && length >= max_cells)
+      break;
+
+    // plain characters get copied straight into the backbuffer
+    auto const run = plain_run(it, measure ? (size_t)(end - it)
+      : (std::min)((size_t)(end - it), max_cells - length));
+
+    if (run > 0) {
+      if (length < max_cells) {
+        copy_run(dst + length, it, (std::min)(run, max_cells - length),
+          attrib.value);
+      }
+
+      it += run;
+      length += run;
+      continue;
+    }
+
+    wchar_t c;
+
+    // escape the # if it's prefixed by a backslash
+    if (end - it >= 2 && it[0] == Char('\\') && it[1] == Char('#')) {
+      c = L'#';
+      it += 2;
+    }
+    // change the attribute
+    else if (end - it > 2 && it[0] == Char('#')) {
+      // foreground
+      if (it[1] != Char('X'))
+        attrib.foreground((uint16_t)(it[1] - Char('0')));
+
+      // background
+      if (it[2] != Char('X'))
+        attrib.background((uint16_t)(it[2] - Char('0')));
+
+      // skip the color code
+      it += 3;
+      continue;
+    }
+    else
+      c = decode(it, end);
+
+    if (length < max_cells)
+      dst[length] = { c, attrib.value };
+
+    length += 1;
+  }
+
+  return { (std::min)(length, max_cells), length };
+}
+
+// a string's true length after color formatting has been removed
+template <typename Char>
+inline size_t string_length(std::basic_string_view<Char> const str) {
+  return layout(str, white, nullptr, 0, true).second;
+}
+
+// the raw bits of a cell, for comparisons
+inline uint32_t cell_bits(CHAR_INFO const& cell) {
+  uint32_t bits;
+  memcpy(&bits, &cell, sizeof(bits));
+  return bits;
+}
+
+// copy a row of cells, reversing it if requested and skipping any cell that
+// is identical to transparent (if it isn't null)
+inline void blit_row(CHAR_INFO* const dst, CHAR_INFO const* const src,
+    size_t const count, bool const reversed, CHAR_INFO const* const transparent) {
+  // plain copy
+  if (!reversed && !transparent) {
+    memcpy(dst, src, count * sizeof(CHAR_INFO));
+    return;
+  }
+
+  size_t i = 0;
+
+#ifdef WINTERM_SSE2
+  auto const key = _mm_set1_epi32(transparent ? (int)cell_bits(*transparent) : 0);
+
+  // 4 cells at a time
+  for (; i + 4 <= count; i += 4) {
+    auto cells = reversed ? _mm_shuffle_epi32(_mm_loadu_si128(
+      (__m128i const*)(src + count - i - 4)), _MM_SHUFFLE(0, 1, 2, 3)) :
+      _mm_loadu_si128((__m128i const*)(src + i));
+
+    // keep the destination wherever the source is transparent
+    if (transparent) {
+      auto const mask = _mm_cmpeq_epi32(cells, key);
+      cells = _mm_or_si128(_mm_andnot_si128(mask, cells), _mm_and_si128(
+        mask, _mm_loadu_si128((__m128i const*)(dst + i))));
+    }
+
+    _mm_storeu_si128((__m128i*)(dst + i), cells);
+  }
+#endif
+
+  for (; i < count; ++i) {
+    auto const& cell = reversed ? src[count - 1 - i] : src[i];
+    if (!transparent || cell_bits(cell) != cell_bits(*transparent))
+      dst[i] = cell;
+  }
+}
+
+// a run of cells on a single row, [first, last)
+struct span {
+  int y, first, last;
+};
+
+// find every run of cells that differs between two frames, in the rows
+// [first_row, last_row), and add them to spans
+// runs separated by only a few unchanged cells are merged, since rewriting
+// those cells is cheaper than moving the cursor
+inline void diff_rows(CHAR_INFO const* const previous, CHAR_INFO const* const cells,
+    vec2 const& size, int const first_row, int const last_row, std::vector<span>& spans) {
+  constexpr int max_gap = 4;
+
+  // a band of rows starts out with no span to extend
+  auto const first_span = spans.size();
+
+  auto const changed = [&](int const y, int const x) {
+    // extend the previous span if it's close enough
+    if (spans.size() > first_span && spans.back().y == y &&
+        x - spans.back().last <= max_gap)
+      spans.back().last = x + 1;
+    else
+      spans.push_back({ y, x, x + 1 });
+  };
+
+  for (int y = first_row; y < last_row; ++y) {
+    auto const row = (size_t)y * size.x;
+
+    // everything changed
+    if (!previous) {
+      spans.push_back({ y, 0, size.x });
+      continue;
+    }
+
+    int x = 0;
+
+#ifdef WINTERM_SSE2
+    auto const load = [](CHAR_INFO const* const p) {
+      return _mm_loadu_si128((__m128i const*)p);
+    };
+
+    // compare 4 cells at a time
+    auto const compare = [&](int const at) {
+      auto const equal = _mm_cmpeq_epi32(load(cells + row + at), load(previous + row + at));
+      auto mask = (unsigned)_mm_movemask_ps(_mm_castsi128_ps(equal)) ^ 0xF;
+
+      for (; mask; mask &= mask - 1)
+        changed(y, at + (int)lowest_bit(mask));
+    };
+
+    // most of a frame is usually the same, so blocks of 16 cells are
+    // checked first and only searched if something in them differs
+    for (; x + 16 <= size.x; x += 16) {
+      auto const a = cells + row + x, b = previous + row + x;
+      auto const diff = _mm_or_si128(
+        _mm_or_si128(_mm_xor_si128(load(a), load(b)),
+          _mm_xor_si128(load(a + 4), load(b + 4))),
+        _mm_or_si128(_mm_xor_si128(load(a + 8), load(b + 8)),
+          _mm_xor_si128(load(a + 12), load(b + 12))));
+
+      if (_mm_movemask_epi8(_mm_cmpeq_epi8(diff, _mm_setzero_si128())) == 0xFFFF)
+        continue;
+
+      for (int i = 0; i < 16; i += 4)
+        compare(x + i);
+    }
+
+    for (; x + 4 <= size.x; x += 4)
+      compare(x);
+#endif
+
+    for (; x < size.x; ++x) {
+      if (cell_bits(cells[row + x]) != cell_bits(previous[row + x]))
+        changed(y, x);
+    }
+  }
+}
+
+// find every run of cells that differs between two frames
+inline void diff_spans(CHAR_INFO const* const previous,
+    CHAR_INFO const* const cells, vec2 const& size, std::vector<span>& spans) {
+  spans.clear();
+  diff_rows(previous, cells, size, 0, size.y, spans);
+}
+
+// hash a row of cells, so rows that didn't change can be found without
+// comparing them to the previous frame cell by cell
+inline uint64_t hash_row(CHAR_INFO const* const cells, int const width) {
+  constexpr uint64_t k = 0x9E3779B97F4A7C15ull;
+
+  auto const bytes = (uint8_t const*)cells;
+  auto const size = (size_t)width * sizeof(CHAR_INFO);
+
+  uint64_t lanes[4] = { k, k * 3, k * 5, k * 7 };
+  size_t i = 0;
+
+  auto const mix = [](uint64_t h, uint64_t const v) {
+    h = (h ^ v) * k;
+    return h ^ (h >> 32);
+  };
+
+#ifdef WINTERM_SSE2
+  // 64 bytes at a time, mixed the way xxh3 does it: the data is xored with
+  // a key that is different at every position, multiplied 32x32->64 and
+  // added to the lanes along with the data itself (so that a multiply by 0
+  // can't hide a change)
+  static constexpr uint64_t keys[10] = {
+    k * 11, k * 13, k * 17, k * 19, k * 23, k * 29, k * 31, k * 37, k, k
+  };
+
+  auto const load = [](void const* const p) {
+    return _mm_loadu_si128((__m128i const*)p);
+  };
+
+  // 4 accumulators so consecutive stripes don't wait on each other
+  auto acc0 = load(lanes), acc1 = load(lanes + 2),
+    acc2 = acc0, acc3 = acc1;
+
+  auto key0 = load(keys), key1 = load(keys + 2),
+    key2 = load(keys + 4), key3 = load(keys + 6);
+
+  auto const step = load(keys + 8);
+
+  auto const accumulate = [](__m128i const acc, __m128i const data, __m128i const key) {
+    auto const keyed = _mm_xor_si128(data, key);
+    auto const product = _mm_mul_epu32(keyed, _mm_srli_epi64(keyed, 32));
+
+    return _mm_add_epi64(_mm_add_epi64(acc, product),
+      _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2)));
+  };
+
+  for (; i + 64 <= size; i += 64) {
+    acc0 = accumulate(acc0, load(bytes + i), key0);
+    acc1 = accumulate(acc1, load(bytes + i + 16), key1);
+    acc2 = accumulate(acc2, load(bytes + i + 32), key2);
+    acc3 = accumulate(acc3, load(bytes + i + 48), key3);
+
+    key0 = _mm_add_epi64(key0, step);
+    key1 = _mm_add_epi64(key1, step);
+    key2 = _mm_add_epi64(key2, step);
+    key3 = _mm_add_epi64(key3, step);
+  }
+
+  // the accumulators are combined with different shuffles, so swapping
+  // the contents of two of them doesn't go unnoticed
+  _mm_storeu_si128((__m128i*)lanes, _mm_add_epi64(acc0,
+    _mm_shuffle_epi32(acc2, _MM_SHUFFLE(1, 0, 3, 2))));
+  _mm_storeu_si128((__m128i*)(lanes + 2), _mm_add_epi64(acc1,
+    _mm_shuffle_epi32(acc3, _MM_SHUFFLE(1, 0, 3, 2))));
+#endif
+
+  // the rest is 8 bytes at a time, a cell is 4 so at most one is left over
+  for (; i + 8 <= size; i += 8) {
+    uint64_t v;
+    memcpy(&v, bytes + i, sizeof(v));
+    lanes[(i >> 3) & 3] = mix(lanes[(i >> 3) & 3], v);
+  }
+
+  if (i < size) {
+    uint32_t v;
+    memcpy(&v, bytes + i, sizeof(v));
+    lanes[3] = mix(lanes[3], v);
+  }
+
+  return mix(mix(lanes[0], lanes[1]) + mix(lanes[2], lanes[3]), size);
+}
+
+// a fixed set of threads that split work into bands along with the thread
+// that hands it out
+class worker_pool {
+public:
+  // threads includes the calling thread, so 1 doesn't start any
+  explicit worker_pool(unsigned const threads) {
+    for (unsigned i = 1; i < threads; ++i)
+      threads_.emplace_back([this, i] { work(i); });
+  }
+
+  ~worker_pool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+
+    wake_.notify_all();
+
+    for (auto& t : threads_)
+      t.join();
+  }
+
+  worker_pool(worker_pool const&) = delete;
+  worker_pool& operator=(worker_pool const&) = delete;
+
+  // the number of bands that run() splits work into
+  unsigned size() const {
+    return (unsigned)threads_.size() + 1;
+  }
+
+  // call job(band) for every band, the calling thread does band 0 itself
+  // returns once every band is done
+  template <typename Job>
+  void run(Job& job) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      job_ = &job;
+      call_ = [](void* const j, unsigned const band) { (*(Job*)j)(band); };
+      remaining_ = (unsigned)threads_.size();
+      generation_ += 1;
+    }
+
+    wake_.notify_all();
+    job(0);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] { return remaining_ == 0; });
+  }
+
+private:
+  // wait for jobs and do a single band of each
+  void work(unsigned const band) {
+    uint64_t seen = 0;
+
+    for (;;) {
+      void* job;
+      void (*call)(void*, unsigned);
+
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        wake_.wait(lock, [&] { return stopping_ || generation_ != seen; });
+
+        if (stopping_)
+          return;
+
+        seen = generation_;
+        job = job_;
+        call = call_;
+      }
+
+      call(job, band);
+
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (--remaining_ == 0)
+        done_.notify_one();
+    }
+  }
+
+private:
+  std::vector<std::thread> threads_;
+
+  std::mutex mutex_;
+  std::condition_variable wake_, done_;
+  bool stopping_ = false;
+
+  // the job that is being worked on, bumping generation_ hands out a new one
+  void* job_ = nullptr;
+  void (*call_)(void*, unsigned) = nullptr;
+  uint64_t generation_ = 0;
+  unsigned remaining_ = 0;
+};
+
+// append a single character as utf-8
+inline void append_utf8(std::string& out, wchar_t const c) {
+  auto const codepoint = (uint32_t)c;
+
+  if (codepoint < 0x80)
+    out.push_back((char)codepoint);
+  else if (codepoint < 0x800) {
+    out.push_back((char)(0xC0 | (codepoint >> 6)));
+    out.push_back((char)(0x80 | (codepoint & 0x3F)));
+  }
+  else {
+    // lone surrogates can't be encoded
+    auto const cp = (codepoint >= 0xD800 && codepoint <= 0xDFFF) ?
+      0xFFFD : codepoint;
+
+    out.push_back((char)(0xE0 | (cp >> 12)));
+    out.push_back((char)(0x80 | ((cp >> 6) & 0x3F)));
+    out.push_back((char)(0x80 | (cp & 0x3F)));
+  }
+}
+
+// append a decimal number
+inline void append_number(std::string& out, int const value) {
+  char buffer[16];
+  auto const length = snprintf(buffer, sizeof(buffer), "%d", value);
+  out.append(buffer, (size_t)length);
+}
+
+// console colors are bgr, vt colors are rgb
+inline int vt_color(uint16_t const color) {
+  return ((color & blue) << 2) | (color & green) | ((color & red) >> 2);
+}
+
+// converts frames into vt sequences, only emitting what changed
+// the encoder remembers where it left the cursor and which colors are set,
+// so the output has to be written to the terminal in order
+class vt_encoder {
+public:
+  // encode the difference between two frames
+  // previous can be null, in which case every cell is written
+  void encode(CHAR_INFO const* const previous, CHAR_INFO const* const cells,
+      vec2 const& size, std::string& out) {
+    diff_spans(previous, cells, size, spans_);
+    encode(spans_, cells, size, out);
+  }
+
+  // encode specific runs of cells
+  void encode(std::vector<span> const& spans, CHAR_INFO const* const cells,
+      vec2 const& size, std::string& out) {
+    for (auto const& s : spans) {
+      move(s.first, s.y, out);
+
+      for (int x = s.first; x < s.last; ++x) {
+        auto const& cell = cells[(size_t)s.y * size.x + x];
+
+        color(cell.Attributes, out);
+        append_utf8(out, cell.Char.UnicodeChar ? cell.Char.UnicodeChar : L' ');
+      }
+
+      // the terminal wraps (or doesn't) when we hit the last column, so
+      // the cursor position isn't reliable anymore
+      cursor_ = s.last >= size.x ? vec2{ -1, -1 } : vec2{ s.last, s.y };
+    }
+  }
+
+  // forget what the terminal looks like (after a resize, for example)
+  void reset() {
+    cursor_ = { -1, -1 };
+    attrib_ = -1;
+  }
+
+private:
+  // move the cursor, using the shortest sequence available
+  void move(int const x, int const y, std::string& out) {
+    if (cursor_.y == y && cursor_.x == x)
+      return;
+
+    // forward on the same row
+    if (cursor_.y == y && cursor_.x >= 0 && cursor_.x < x) {
+      out += "\x1b[";
+      append_number(out, x - cursor_.x);
+      out += 'C';
+    }
+    else {
+      out += "\x1b[";
+      append_number(out, y + 1);
+      out += ';';
+      append_number(out, x + 1);
+      out += 'H';
+    }
+
+    cursor_ = { x, y };
+  }
+
+  // set the foreground and background colors, if they changed
+  void color(uint16_t const attrib, std::string& out) {
+    auto const fg = attrib & 0xF, bg = (attrib >> 4) & 0xF;
+    auto const fg_changed = attrib_ < 0 || fg != (attrib_ & 0xF);
+    auto const bg_changed = attrib_ < 0 || bg != ((attrib_ >> 4) & 0xF);
+
+    if (!fg_changed && !bg_changed)
+      return;
+
+    out += "\x1b[";
+
+    if (fg_changed)
+      append_number(out, ((fg & intense) ? 90 : 30) + vt_color(fg & white));
+
+    if (fg_changed && bg_changed)
+      out += ';';
+
+    if (bg_changed)
+      append_number(out, ((bg & intense) ? 100 : 40) + vt_color(bg & white));
+
+    out += 'm';
+    attrib_ = attrib & 0xFF;
+  }
+
+private:
+  // where the terminal's cursor is, or -1 if we don't know
+  vec2 cursor_ = { -1, -1 };
+
+  // the terminal's current colors, or -1 if we don't know
+  int attrib_ = -1;
+
+  std::vector<span> spans_;
+};
+
+// everything about a console that is being rendered to
+struct context_state {
+  // handle to the win32 console
+  HANDLE out_handle = nullptr,
+    in_handle = nullptr;
+
+  // this is the size of our console in characters, not pixels
+  vec2 size = { 0, 0 };
+
+  // the input color
+  attribute input_attrib = { white, black };
+
+  // an array of characters that will be written to the console all at once
+  // to improve performance and reduce tearing
+  std::unique_ptr<CHAR_INFO[]> backbuffer;
+
+  // a single row of cells used for laying out centered strings
+  std::unique_ptr<CHAR_INFO[]> scratch;
+
+  // the number of cells allocated for the backbuffer and scratch row,
+  // which can be bigger than the console after shrinking
+  size_t capacity = 0;
+  int scratch_capacity = 0;
+
+  // keep the backbuffer contents when resizing
+  bool preserve_on_resize = false;
+
+  // a resize that will be applied after the next flush
+  vec2 pending_size = { 0, 0 };
+
+  // whether the user is allowed to resize the window
+  bool resizable = false;
+
+  // a window size that is waiting to settle before it gets applied
+  vec2 detected_size = { 0, 0 };
+  std::chrono::steady_clock::time_point detected_time;
+
+  // called after resizing between frames
+  std::function<void(vec2 const&)> resize_callback;
+
+  // functions that get called after every flush
+  std::vector<std::pair<int, flush_hook>> flush_hooks;
+  int next_flush_hook_id = 0;
+
+  // memory for things that only live for a single frame, reset on flush
+  frame_arena arena;
+
+  // write vt sequences instead of cells
+  bool vt_output = false;
+
+  // what the console looks like, so only the changes have to be written
+  std::vector<CHAR_INFO> presented;
+  vec2 presented_size = { 0, 0 };
+  vt_encoder encoder;
+
+  // a hash of every row of presented, and of the frame being presented, so
+  // rows that didn't change are skipped without comparing every cell
+  std::vector<uint64_t> presented_hashes, row_hashes;
+
+  // hash the flushed frame without vt output as well (vt output always
+  // does), only once needs_flush() has been asked
+  bool hash_flushed = false;
+
+  // the whole frame is staged here and written all at once
+  std::string output;
+  output_stats vt_stats;
+
+  // write less when the output can't keep up
+  bool bandwidth_aware = false;
+  size_t bandwidth_limit = 0;
+
+  // parts of the screen, by importance
+  struct region {
+    int id;
+    rect area;
+    int priority, interval;
+
+    // the last frame anything in this region was written
+    size_t updated = SIZE_MAX;
+  };
+
+  std::vector<region> regions;
+  int next_region_id = 0,
+    focused_region = -1;
+
+  // the average time between frames, in seconds
+  double frame_interval = 0.0;
+  std::chrono::steady_clock::time_point last_present;
+
+  // threads that find what changed, in bands of rows
+  unsigned diff_threads = 1;
+  std::unique_ptr<worker_pool> diff_pool;
+  std::vector<std::vector<span>> band_spans;
+
+  // reused every frame
+  std::vector<span> spans, one_span;
+  std::vector<std::pair<int, size_t>> order;
+  std::vector<CHAR_INFO> degraded;
+
+  // cells that went out with their colors reduced (presented has their
+  // real colors), and how many there are, they're written again at full
+  // color once there's room for it
+  std::vector<uint8_t> reduced;
+  size_t reduced_cells = 0;
+  std::vector<std::pair<uint64_t, int>> old_rows;
+  std::vector<int> shift_votes;
+};
+
+// the context the calling thread renders to, null for the process console
+inline context_state*& current_state() {
+  thread_local context_state* current = nullptr;
+  return current;
+}
+
+// stores the current state of the console
+inline context_state& state() {
+  if (auto const current = current_state())
+    return *current;
+
+  static context_state s;
+  return s;
+}
+
+// render a string to the console
+template <typename Char>
+inline std::pair<int, int> string(vec2 const& position, attribute const attrib,
+    bool const centered, std::basic_string_view<Char> const str) {
+  assert(position.x >= 0 && position.y >= 0);
+  assert(position.y < state().size.y);
+
+  auto const width = (size_t)state().size.x;
+  auto const row = &state().backbuffer[(size_t)position.y * width];
+
+  if (!centered) {
+    // starts past the end of the row, nothing fits
+    if ((size_t)position.x >= width)
+      return { position.x, position.x - 1 };
+
+    auto const written = layout(str, attrib,
+      row + position.x, width - position.x, false).first;
+
+    return { position.x, position.x + (int)written - 1 };
+  }
+
+  // centering depends on the length of the string, so lay it out in a
+  // scratch row first to avoid traversing the string twice
+  auto const [written, length] = layout(str, 
+    attrib, state().scratch.get(), width, true);
+
+  // first character index (relative to the start of the row)
+  auto const first = length / 2 > (size_t)position.x ? 
+    0 : position.x - (int)(length / 2);
+
+  // starts past the end of the row, nothing fits
+  if ((size_t)first >= width)
+    return { first, first - 1 };
+
+  auto const count = (std::min)(written, width - first);
+  memcpy(row + first, state().scratch.get(), count * sizeof(CHAR_INFO));
+
+  return { first, first + (int)count - 1 };
+}
+
+// copy a block of cells from a surface to the backbuffer
+inline void blit(surface const& src, rect const& src_rect, vec2 const& position,
+    CHAR_INFO const* const transparent, int const flags) {
+  auto const console = state().size;
+  auto const size = src.size();
+  auto const& r = src_rect;
+
+  // the range of destination offsets that lands on the console and reads
+  // from inside of the surface
+  auto const visible = [](int const offset, int const length, int const limit,
+      int const src_offset, int const src_limit, bool const flipped) {
+    auto first = (std::max)(0, -offset);
+    auto last = (std::min)(length, limit - offset);
+
+    if (flipped) {
+      first = (std::max)(first, src_offset + length - src_limit);
+      last = (std::min)(last, src_offset + length);
+    }
+    else {
+      first = (std::max)(first, -src_offset);
+      last = (std::min)(last, src_limit - src_offset);
+    }
+
+    return std::pair{ first, last };
+  };
+
+  auto const horizontal = (flags & flip_horizontal) != 0;
+  auto const vertical = (flags & flip_vertical) != 0;
+
+  auto const [x0, x1] = visible(position.x, r.width, console.x, r.x, size.x, horizontal);
+  auto const [y0, y1] = visible(position.y, r.height, console.y, r.y, size.y, vertical);
+
+  if (x0 >= x1 || y0 >= y1)
+    return;
+
+  // the first source column that gets copied (the last one if reversed)
+  auto const src_x = horizontal ? r.x + r.width - x1 : r.x + x0;
+
+  for (int y = y0; y < y1; ++y) {
+    auto const src_y = vertical ? r.y + r.height - 1 - y : r.y + y;
+
+    blit_row(&state().backbuffer[(size_t)(position.y + y) * console.x + position.x + x0],
+      &src.cells()[(size_t)src_y * size.x + src_x], (size_t)(x1 - x0),
+      horizontal, transparent);
+  }
+}
+
+// move the rows of the backbuffer to match a new width, in place
+// cells that weren't part of the old backbuffer are cleared
+inline void reflow(CHAR_INFO* const cells, vec2 const& from, vec2 const& to) {
+  auto const rows = (std::min)(from.y, to.y);
+  auto const columns = (size_t)(std::min)(from.x, to.x);
+
+  // narrower (or same width), rows only move backwards
+  if (to.x <= from.x) {
+    for (int y = 0; y < rows; ++y) {
+      memmove(cells + (size_t)y * to.x, cells + 
+        (size_t)y * from.x, columns * sizeof(CHAR_INFO));
+    }
+  }
+  // wider, rows only move forwards
+  else {
+    for (int y = rows - 1; y >= 0; --y) {
+      auto const row = cells + (size_t)y * to.x;
+      memmove(row, cells + (size_t)y * from.x, columns * sizeof(CHAR_INFO));
+      memset(row + columns, 0, (to.x - columns) * sizeof(CHAR_INFO));
+    }
+  }
+
+  // new rows at the bottom
+  auto const used = (size_t)(rows < 0 ? 0 : rows) * to.x;
+  memset(cells + used, 0, ((size_t)to.x * to.y - used) * sizeof(CHAR_INFO));
+}
+
+// resize the backbuffer, reusing the existing allocation if it's big enough
+inline void resize_backbuffer(vec2 const& size) {
+  auto& s = state();
+  auto const num_chars = (size_t)size.x * (size_t)size.y;
+  assert(num_chars > 0);
+
+  if (num_chars > s.capacity) {
+    // leave some room so that growing a little bit later on is free
+    auto const capacity = (std::max)(num_chars, s.capacity + s.capacity / 2);
+    auto cells = std::make_unique<CHAR_INFO[]>(capacity);
+
+    if (s.preserve_on_resize) {
+      auto const rows = (std::min)(s.size.y, size.y);
+      auto const columns = (size_t)(std::min)(s.size.x, size.x);
+
+      for (int y = 0; y < rows; ++y) {
+        memcpy(&cells[(size_t)y * size.x], &s.backbuffer[(size_t)y * s.size.x],
+          columns * sizeof(CHAR_INFO));
+      }
+    }
+
+    s.backbuffer = std::move(cells);
+    s.capacity = capacity;
+  }
+  else if (s.preserve_on_resize)
+    reflow(s.backbuffer.get(), s.size, size);
+  else
+    memset(s.backbuffer.get(), 0, num_chars * sizeof(CHAR_INFO));
+
+  if (size.x > s.scratch_capacity) {
+    s.scratch = std::make_unique<CHAR_INFO[]>(size.x);
+    s.scratch_capacity = size.x;
+  }
+
+  s.size = size;
+}
+
+// resize the console's screen buffer and window
+inline void resize_console(vec2 const& size) {
+  auto const handle = state().out_handle;
+
+  // the window always has to fit inside of the screen buffer, read the 
+  // remarks section in the following pages for the gory details
+  // https://docs.microsoft.com/en-us/windows/console/setconsolewindowinfo
+  // https://docs.microsoft.com/en-us/windows/console/setconsolescreenbuffersize
+
+  // nothing to resize if it isn't a console screen buffer
+  CONSOLE_SCREEN_BUFFER_INFO info;
+  if (!GetConsoleScreenBufferInfo(handle, &info))
+    return;
+
+  vec2 window = { info.srWindow.Right - info.srWindow.Left + 1,
+    info.srWindow.Bottom - info.srWindow.Top + 1 };
+
+  // already the right size
+  if (window.x == size.x && window.y == size.y &&
+      info.dwSize.X == size.x && info.dwSize.Y == size.y)
+    return;
+
+  // shrink the window first if it wouldn't fit in the new screen buffer
+  if (window.x > size.x || window.y > size.y) {
+    window = { (std::min)(window.x, size.x), (std::min)(window.y, size.y) };
+
+    SMALL_RECT const rect{ 0, 0, (short)(window.x - 1), (short)(window.y - 1) };
+    SetConsoleWindowInfo(handle, TRUE, &rect);
+  }
+
+  if (info.dwSize.X != size.x || info.dwSize.Y != size.y)
+    SetConsoleScreenBufferSize(handle, { (short)size.x, (short)size.y });
+
+  // now the window can grow to fill the screen buffer
+  if (window.x != size.x || window.y != size.y) {
+    SMALL_RECT const rect{ 0, 0, (short)(size.x - 1), (short)(size.y - 1) };
+    SetConsoleWindowInfo(handle, TRUE, &rect);
+  }
+}
+
+// dragging the window border generates a lot of sizes in a row, so a new
+// size has to stay the same for this long before it gets applied
+constexpr auto resize_debounce = std::chrono::milliseconds(100);
+
+// check whether the user resized the console window
+inline void detect_resize() {
+  auto& s = state();
+
+  CONSOLE_SCREEN_BUFFER_INFO info;
+  if (!GetConsoleScreenBufferInfo(s.out_handle, &info))
+    return;
+
+  vec2 const window = { info.srWindow.Right - info.srWindow.Left + 1,
+    info.srWindow.Bottom - info.srWindow.Top + 1 };
+
+  // nothing changed (or it was changed back)
+  if (window.x == s.size.x && window.y == s.size.y) {
+    s.detected_size = { 0, 0 };
+    return;
+  }
+
+  auto const now = std::chrono::steady_clock::now();
+
+  // still being resized
+  if (window.x != s.detected_size.x || window.y != s.detected_size.y) {
+    s.detected_size = window;
+    s.detected_time = now;
+    return;
+  }
+
+  if (now - s.detected_time >= resize_debounce) {
+    s.pending_size = window;
+    s.detected_size = { 0, 0 };
+  }
+}
+
+// allow or prevent resizing the console window
+inline void set_resizable(bool const resizable) {
+  auto const window = GetConsoleWindow();
+  auto const style = GetWindowLong(window, GWL_STYLE);
+
+  SetWindowLong(window, GWL_STYLE, resizable ? 
+    (style | (WS_MAXIMIZEBOX | WS_SIZEBOX)) :
+    (style & ~(WS_MAXIMIZEBOX | WS_SIZEBOX)));
+
+  state().resizable = resizable;
+  state().detected_size = { 0, 0 };
+}
+
+// hide the blinking cursor
+inline void disable_cursor() {
+  CONSOLE_CURSOR_INFO info;
+  GetConsoleCursorInfo(state().out_handle, &info);
+
+  info.bVisible = false;
+  SetConsoleCursorInfo(state().out_handle, &info);
+}
+
+// unhide (show) the blinking cursor
+inline void enable_cursor() {
+  CONSOLE_CURSOR_INFO info;
+  GetConsoleCursorInfo(state().out_handle, &info);
+
+  info.bVisible = true;
+  SetConsoleCursorInfo(state().out_handle, &info);
+}
+
+// is the cursor visible?
+inline bool cursor_enabled() {
+  CONSOLE_CURSOR_INFO info;
+  GetConsoleCursorInfo(state().out_handle, &info);
+  return info.bVisible;
+}
+
+// make it so you cant highlight stuff in the console
+inline void disable_highlighting() {
+  DWORD mode;
+  GetConsoleMode(state().in_handle, &mode);
+  SetConsoleMode(impl::state().in_handle,
+    (mode & ~ENABLE_QUICK_EDIT_MODE) | ENABLE_EXTENDED_FLAGS);
+}
+
+// enable highlighting
+inline void enable_highlighting() {
+  DWORD mode;
+  GetConsoleMode(state().in_handle, &mode);
+  SetConsoleMode(impl::state().in_handle, 
+    (mode | ENABLE_QUICK_EDIT_MODE) | ENABLE_EXTENDED_FLAGS);
+}
+
+// is highlighting currently enabled
+inline bool highlighting_enabled() {
+  DWORD mode;
+  GetConsoleMode(state().in_handle, &mode);
+  return (mode & ENABLE_EXTENDED_FLAGS) && (mode & ENABLE_QUICK_EDIT_MODE);
+}
+
+// turn vt output on or off
+inline void set_vt_output(bool const enabled) {
+  auto& s = state();
+
+  // pipes and files take whatever is written to them, only consoles have
+  // to be told about vt sequences
+  DWORD mode;
+  if (enabled && s.out_handle && GetConsoleMode(s.out_handle, &mode)) {
+    // older consoles don't understand vt sequences at all
+    if (!SetConsoleMode(s.out_handle, mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING))
+      return;
+
+    SetConsoleOutputCP(CP_UTF8);
+  }
+
+  s.vt_output = enabled;
+
+  // whatever is on the screen now wasn't written by us
+  s.presented.clear();
+  s.presented_hashes.clear();
+}
+
+// the region a run of cells belongs to (the one containing its first cell
+// with the highest priority), null if it isn't in any
+inline context_state::region* find_region(span const& sp) {
+  context_state::region* found = nullptr;
+
+  for (auto& r : state().regions) {
+    if (sp.y >= r.area.y && sp.y < r.area.y + r.area.height &&
+        sp.first >= r.area.x && sp.first < r.area.x + r.area.width &&
+        (!found || r.priority > found->priority))
+      found = &r;
+  }
+
+  return found;
+}
+
+// find every run of cells that changed in the rows [first_row, last_row),
+// only comparing the cells of rows whose hash changed
+// the state is passed in since this runs on the diff threads, which don't
+// have the context current
+inline void diff_hashed_rows(context_state& s, CHAR_INFO const* const cells,
+    int const first_row, int const last_row, std::vector<span>& spans) {
+  for (int y = first_row; y < last_row; ++y) {
+    auto const hash = hash_row(cells + (size_t)y * s.size.x, s.size.x);
+    s.row_hashes[y] = hash;
+
+    if (hash != s.presented_hashes[y])
+      diff_rows(s.presented.data(), cells, s.size, y, y + 1, spans);
+  }
+}
+
+// the diff, with the rows split into bands across the diff threads
+inline void diff_bands(CHAR_INFO const* const cells, size_t const count,
+    size_t const min_band_cells) {
+  auto& s = state();
+
+  if (!s.diff_pool || s.diff_pool->size() != s.diff_threads)
+    s.diff_pool = std::make_unique<worker_pool>(s.diff_threads);
+
+  auto const bands = (int)(std::min)((size_t)s.diff_threads,
+    (std::min)((size_t)s.size.y, count / min_band_cells));
+
+  s.band_spans.resize(s.diff_pool->size());
+
+  auto job = [&](unsigned const band) {
+    auto& spans = s.band_spans[band];
+    spans.clear();
+
+    if ((int)band >= bands)
+      return;
+
+    diff_hashed_rows(s, cells, s.size.y * (int)band / bands,
+      s.size.y * ((int)band + 1) / bands, spans);
+  };
+
+  s.diff_pool->run(job);
+
+  // the bands are in order and spans never cross rows, so they only have
+  // to be put one after another
+  s.spans.clear();
+  for (auto const& spans : s.band_spans)
+    s.spans.insert(end(s.spans), begin(spans), end(spans));
+}
+
+// find every run of cells that changed since the last frame that was
+// presented, splitting the rows into bands across the diff threads
+inline void diff_presented(CHAR_INFO const* const cells) {
+  auto& s = state();
+  auto const count = (size_t)s.size.x * (size_t)s.size.y;
+
+  s.row_hashes.resize((size_t)s.size.y);
+
+  // below this, waking the threads up costs more than it saves
+  constexpr size_t min_band_cells = 16 * 1024;
+
+  if (s.diff_threads <= 1 || count < min_band_cells * 2) {
+    s.spans.clear();
+    diff_hashed_rows(s, cells, 0, s.size.y, s.spans);
+  }
+  else
+    diff_bands(cells, count, min_band_cells);
+
+  s.vt_stats.rows += (size_t)s.size.y;
+
+  for (int y = 0; y < s.size.y; ++y) {
+    if (s.row_hashes[y] == s.presented_hashes[y])
+      s.vt_stats.rows_skipped += 1;
+  }
+}
+
+// find a block of rows that moved up or down since the last frame (a log
+// scrolling, for example) and scroll it on the terminal instead of writing
+// it again, like curses does, so only the rows that scrolled into view have
+// to be written
+// rows are matched by their hashes, and since the terminal can only scroll
+// whole rows, this only finds blocks that span the whole width
+// returns true if something was scrolled (presented is updated to match)
+inline bool scroll_presented() {
+  auto& s = state();
+  auto const height = s.size.y;
+  auto const& now = s.row_hashes;
+  auto const& old = s.presented_hashes;
+
+  // the old rows by hash, so the rows that changed can be looked up
+  s.old_rows.clear();
+  for (int y = 0; y < height; ++y)
+    s.old_rows.push_back({ old[y], y });
+
+  std::sort(begin(s.old_rows), end(s.old_rows));
+
+  // every row that changed votes for how far it moved, rows that show up
+  // many times (blank ones) don't say anything about that
+  constexpr ptrdiff_t max_repeats = 4;
+
+  s.shift_votes.assign((size_t)height * 2, 0);
+
+  for (int y = 0; y < height; ++y) {
+    if (now[y] == old[y])
+      continue;
+
+    auto const [first, last] = std::equal_range(begin(s.old_rows), end(s.old_rows),
+      std::pair<uint64_t, int>{ now[y], 0 },
+      [](auto const& a, auto const& b) { return a.first < b.first; });
+
+    if (last - first > max_repeats)
+      continue;
+
+    for (auto it = first; it != last; ++it)
+      s.shift_votes[(size_t)(it->second - y + height)] += 1;
+  }
+
+  auto const best = std::max_element(begin(s.shift_votes), end(s.shift_votes));
+  if (*best < 2)
+    return false;
+
+  // how far the rows moved up (negative is down)
+  auto const shift = (int)(best - begin(s.shift_votes)) - height;
+
+  // the run of rows that lines up with the shift and would be written
+  // otherwise the most
+  auto const matches = [&](int const y) {
+    return y + shift >= 0 && y + shift < height && now[y] == old[y + shift];
+  };
+
+  int run_first = 0, run_last = 0, gain = 0;
+
+  for (int y = 0; y < height;) {
+    if (!matches(y)) {
+      ++y;
+      continue;
+    }
+
+    auto const first = y;
+    auto changed = 0;
+
+    for (; y < height && matches(y); ++y)
+      changed += now[y] != old[y];
+
+    if (changed > gain) {
+      run_first = first;
+      run_last = y;
+      gain = changed;
+    }
+  }
+
+  // the scroll region is the run plus the rows that scroll into view, which
+  // have to be written even if they were the same before
+  auto const distance = shift > 0 ? shift : -shift;
+  auto const top = shift > 0 ? run_first : run_first - distance,
+    bottom = shift > 0 ? run_last + distance : run_last;
+  auto const exposed = shift > 0 ? run_last : top;
+
+  auto lost = 0;
+  for (int y = exposed; y < exposed + distance; ++y)
+    lost += now[y] == old[y];
+
+  // moving the cursor and scrolling costs about as much as writing a row
+  if (gain - lost < 2)
+    return false;
+
+  // scroll just the region, then put the scroll region back
+  s.output += "\x1b[";
+  append_number(s.output, top + 1);
+  s.output += ';';
+  append_number(s.output, bottom);
+  s.output += "r\x1b[";
+  append_number(s.output, distance);
+  s.output += shift > 0 ? "S" : "T";
+  s.output += "\x1b[r";
+
+  // setting the scroll region moves the cursor
+  s.encoder.reset();
+  s.vt_stats.scrolls += 1;
+
+  // the terminal moved these rows, so now presented has to as well
+  auto const width = (size_t)s.size.x;
+  auto const rows = s.presented.data();
+  auto& hashes = s.presented_hashes;
+
+  if (shift > 0) {
+    memmove(rows + top * width, rows + (top + distance) * width,
+      (size_t)(bottom - top - distance) * width * sizeof(CHAR_INFO));
+    std::copy(begin(hashes) + top + distance, begin(hashes) + bottom,
+      begin(hashes) + top);
+  }
+  else {
+    memmove(rows + (top + distance) * width, rows + top * width,
+      (size_t)(bottom - top - distance) * width * sizeof(CHAR_INFO));
+    std::copy_backward(begin(hashes) + top, begin(hashes) + bottom - distance,
+      begin(hashes) + bottom);
+  }
+
+  // cells with reduced colors move along with them
+  if (s.reduced_cells > 0) {
+    auto const reduced = s.reduced.data();
+
+    if (shift > 0) {
+      memmove(reduced + top * width, reduced + (top + distance) * width,
+        (size_t)(bottom - top - distance) * width);
+    }
+    else {
+      memmove(reduced + (top + distance) * width, reduced + top * width,
+        (size_t)(bottom - top - distance) * width);
+    }
+
+    std::fill(reduced + exposed * width, reduced + (exposed + distance) * width,
+      (uint8_t)0);
+    s.reduced_cells = (size_t)std::count(begin(s.reduced), end(s.reduced), (uint8_t)1);
+  }
+
+  // whatever the terminal filled the new rows with, they're written again
+  std::fill(rows + exposed * width, rows + (exposed + distance) * width,
+    CHAR_INFO{ 0xFFFF, 0xFFFF });
+  std::fill(begin(hashes) + exposed, begin(hashes) + exposed + distance,
+    hash_row(rows + exposed * width, s.size.x));
+
+  // find what still differs after scrolling
+  s.spans.clear();
+
+  for (int y = 0; y < height; ++y) {
+    if (now[y] != hashes[y])
+      diff_rows(rows, s.backbuffer.get(), s.size, y, y + 1, s.spans);
+  }
+
+  return true;
+}
+
+// the number of bytes that can be written per frame without falling behind
+inline size_t frame_budget() {
+  auto const& s = state();
+  auto const throughput = s.bandwidth_limit ?
+    (double)s.bandwidth_limit : s.vt_stats.throughput;
+
+  // nothing measured yet
+  if (throughput <= 0.0 || s.frame_interval <= 0.0)
+    return SIZE_MAX;
+
+  return (size_t)(throughput * s.frame_interval);
+}
+
+// write as much of the changes as the budget allows, most important first
+// colors outside of the focused region are reduced to the 8 basic ones,
+// which needs fewer color changes, and anything that doesn't fit is left
+// for a later frame
+inline void encode_constrained(size_t const start, size_t const budget) {
+  auto& s = state();
+  auto const cells = s.backbuffer.get();
+
+  s.output.resize(start);
+  s.encoder.reset();
+  s.vt_stats.constrained_frames += 1;
+
+  // most important first, top to bottom otherwise
+  s.order.clear();
+
+  for (size_t i = 0; i < s.spans.size(); ++i) {
+    auto const r = find_region(s.spans[i]);
+    auto const priority = !r ? 0 : (r->id == s.focused_region ? INT_MAX : r->priority);
+    s.order.push_back({ priority, i });
+  }
+
+  std::stable_sort(begin(s.order), end(s.order),
+    [](auto const& a, auto const& b) { return a.first > b.first; });
+
+  s.degraded.resize(s.presented.size());
+
+  for (size_t i = 0; i < s.order.size(); ++i) {
+    auto const& sp = s.spans[s.order[i].second];
+    auto const r = find_region(sp);
+
+    // updated too recently (an earlier run in this same frame doesn't count)
+    auto const waiting = r && r->updated != SIZE_MAX && r->updated != s.vt_stats.frames &&
+      s.vt_stats.frames - r->updated < (size_t)r->interval;
+
+    if (waiting || s.output.size() - start >= budget) {
+      s.vt_stats.deferred_spans += 1;
+      continue;
+    }
+
+    auto const row = (size_t)sp.y * s.size.x;
+    auto const focused = r && r->id == s.focused_region;
+
+    for (int x = sp.first; x < sp.last; ++x) {
+      auto const cell = cells[row + x];
+
+      auto degraded = cell;
+      if (!focused)
+        degraded.Attributes &= ~(WORD)((intense << 4) | intense);
+
+      // presented keeps the real colors, otherwise these cells would look
+      // like they changed again on every frame
+      s.degraded[row + x] = degraded;
+      s.presented[row + x] = cell;
+
+      auto const is_reduced = (uint8_t)(degraded.Attributes != cell.Attributes);
+      s.reduced_cells += is_reduced;
+      s.reduced_cells -= s.reduced[row + x];
+      s.reduced[row + x] = is_reduced;
+    }
+
+    s.one_span.assign(1, sp);
+    s.encoder.encode(s.one_span, s.degraded.data(), s.size, s.output);
+
+    if (r)
+      r->updated = s.vt_stats.frames;
+  }
+
+  // only part of these rows was written, so they need a hash of what is
+  // actually on the screen (the rest of the rows didn't change)
+  for (size_t i = 0; i < s.spans.size(); ++i) {
+    auto const y = s.spans[i].y;
+
+    if (i == 0 || s.spans[i - 1].y != y) {
+      s.presented_hashes[y] = hash_row(
+        &s.presented[(size_t)y * s.size.x], s.size.x);
+    }
+  }
+}
+
+// write the cells that went out with their colors reduced again, at full
+// color, with whatever is left of the budget once everything that actually
+// changed was written
+inline void restore_reduced(size_t const start, size_t const budget) {
+  auto& s = state();
 
-// the length of a string after formatting is applied
-template <typename ...Args>
-size_t string_len(wchar_t const* format, Args&& ...args);
+  for (int y = 0; y < s.size.y && s.reduced_cells > 0; ++y) {
+    auto const row = (size_t)y * s.size.x;
 
-// get user input
-template <typename T>
-bool input(vec2 position, T& value);
+    for (int x = 0; x < s.size.x;) {
+      if (!s.reduced[row + x]) {
+        ++x;
+        continue;
+      }
 
+      if (s.output.size() - start >= budget)
+        return;
 
-//
-//
-// implmentation below
-//
-//
+      auto last = x;
+      while (last < s.size.x && s.reduced[row + last])
+        ++last;
 
+      // presented is what the terminal should be showing, the backbuffer
+      // may have changed since in a span that is still waiting
+      s.one_span.assign(1, span{ y, x, last });
+      s.encoder.encode(s.one_span, s.presented.data(), s.size, s.output);
 
-namespace impl {
+      std::fill(&s.reduced[row + x], &s.reduced[row + last], (uint8_t)0);
+      s.reduced_cells -= (size_t)(last - x);
+      x = last;
+    }
+  }
+}
 
-// stores the current state of the console
-inline auto& state() {
-  struct {
+// write the changes since the last frame as vt sequences
+// everything is staged and written with as few writes as possible (one,
+// unless the console only accepts part of it), since every write is a
+// round trip through conhost or the terminal
+inline void present_vt() {
+  using clock = std::chrono::steady_clock;
 
-    // handle to the win32 console
-    HANDLE out_handle = nullptr,
-      in_handle = nullptr;
+  auto& s = state();
+  auto const count = (size_t)s.size.x * (size_t)s.size.y;
+  auto const cells = s.backbuffer.get();
 
-    // this is the size of our console in characters, not pixels
-    vec2 size = { 0, 0 };
+  // how often frames are presented, long pauses don't count
+  auto const now = clock::now();
+  auto const interval = (std::min)(1.0,
+    std::chrono::duration<double>(now - s.last_present).count());
 
-    // the input color
-    attribute input_attrib = { white, black };
+  s.frame_interval = s.frame_interval <= 0.0 ?
+    interval : s.frame_interval * 0.8 + interval * 0.2;
+  s.last_present = now;
 
-    // an array of characters that will be written to the console all at once
-    // to improve performance and reduce tearing
-    std::unique_ptr<CHAR_INFO[]> backbuffer;
+  // draw the whole frame in a single step on terminals that support
+  // synchronized output (mode 2026), the rest ignore the sequence
+  // the cursor is also put back where it was, in case someone moved it
+  s.output.assign("\x1b[?2026h\x1b" "7");
+  auto const prefix = s.output.size();
 
-  } static s;
+  // the cursor may have been moved since the last frame
+  s.encoder.reset();
 
-  return s;
-}
+  // first frame, or the size changed
+  if (s.presented.size() != count || s.presented_size.x != s.size.x) {
+    s.output += "\x1b[0m\x1b[2J";
 
-// a string's true length after color formatting has been removed
-inline size_t string_length(wchar_t const* const str) {
-  auto const size = lstrlenW(str);
-  size_t real_length = 0;
+    // nothing is on the screen until it's written, so every cell differs
+    s.presented.assign(count, CHAR_INFO{ 0xFFFF, 0xFFFF });
+    s.presented_size = s.size;
 
-  for (int i = 0; i < size; ++i) {
-    // escape the # if it's prefixed by a backslash
-    if (i + 1 < size && str[i] == L'\\' && str[i + 1] == L'#')
-      i += 1;
-    else if (i + 2 < size && str[i] == L'#') {
-      i += 2;
-      continue;
-    }
+    s.presented_hashes.assign((size_t)s.size.y,
+      hash_row(s.presented.data(), s.size.x));
 
-    real_length += 1;
+    s.reduced.assign(count, 0);
+    s.reduced_cells = 0;
   }
 
-  return real_length;
-}
+  diff_presented(cells);
+  scroll_presented();
 
-// render a string to the console
-inline std::pair<int, int> string(vec2 const& position, attribute attrib,
-    bool const centered, wchar_t const* const str) {
-  assert(position.x >= 0 && position.y >= 0);
-  assert(position.y < state().size.y);
+  auto const start = s.output.size();
+  s.encoder.encode(s.spans, cells, s.size, s.output);
 
-  // number of characters in the string (but not necessarily the number of 
-  // characters that will be drawn)
-  auto const size = lstrlenW(str);
+  auto const budget = s.bandwidth_aware ? frame_budget() : SIZE_MAX;
 
-  // first character index
-  auto start = (size_t)position.x + (size_t)position.y * state().size.x;
+  if (s.output.size() - start > budget)
+    encode_constrained(start, budget);
+  else {
+    s.presented.assign(cells, cells + count);
+    s.presented_hashes.swap(s.row_hashes);
 
-  // apply centering if requested
-  if (centered) {
-    auto const len = string_length(str);
-    if (len / 2 > (size_t)position.x)
-      start -= position.x;
-    else
-      start -= len / 2;
+    // everything that changed went out at full color
+    for (auto const& sp : s.spans) {
+      auto const row = (size_t)sp.y * s.size.x;
+
+      for (int x = sp.first; x < sp.last && s.reduced_cells > 0; ++x) {
+        s.reduced_cells -= s.reduced[row + x];
+        s.reduced[row + x] = 0;
+      }
+    }
   }
 
-  int xpos = 0;
+  restore_reduced(start, budget);
 
-  // render each character in the string
-  for (int i = 0; i < size; ++i) {
-    // we reached the end
-    if (position.x + xpos >= state().size.x)
-      break;
+  s.vt_stats.frames += 1;
 
-    // escape the # if it's prefixed by a backslash
-    if (i + 1 < size && str[i] == L'\\' && str[i + 1] == L'#')
-      continue;
-    // change the attribute
-    else if (i + 2 < size && str[i] == L'#') {
-      // foreground
-      if (str[i + 1] != L'X')
-        attrib.foreground = (uint16_t)(str[i + 1] - L'0');
+  // nothing changed
+  if (s.output.size() == prefix)
+    return;
 
-      // background
-      if (str[i + 2] != L'X')
-        attrib.background = (uint16_t)(str[i + 2] - L'0');
+  s.output += "\x1b" "8\x1b[?2026l";
 
-      // skip the next two color codes
-      i += 2;
-      continue;
-    }
+  auto const write_start = clock::now();
 
-    state().backbuffer[start + xpos] = {
-      str[i], *(uint16_t*)&attrib
-    };
+  for (size_t written = 0; written < s.output.size();) {
+    DWORD n = 0;
 
-    xpos += 1;
-  }
+    if (!WriteFile(s.out_handle, s.output.data() + written,
+        (DWORD)(s.output.size() - written), &n, nullptr) || n == 0)
+      break;
 
-  auto const first = (int)start - (position.y * state().size.x);
-  return { first, first + (int)xpos - 1 };
-}
+    s.vt_stats.writes += 1;
+    s.vt_stats.bytes += n;
 
-// hide the blinking cursor
-inline void disable_cursor() {
-  CONSOLE_CURSOR_INFO info;
-  GetConsoleCursorInfo(state().out_handle, &info);
+    // keep going from wherever it stopped
+    if (written + n < s.output.size())
+      s.vt_stats.partial_writes += 1;
 
-  info.bVisible = false;
-  SetConsoleCursorInfo(state().out_handle, &info);
-}
+    written += n;
+  }
 
-// unhide (show) the blinking cursor
-inline void enable_cursor() {
-  CONSOLE_CURSOR_INFO info;
-  GetConsoleCursorInfo(state().out_handle, &info);
+  // writes that return right away only say that the output is fast, not
+  // how fast, so they're treated as taking at least 0.1ms
+  auto const seconds = (std::max)(1e-4,
+    std::chrono::duration<double>(clock::now() - write_start).count());
+  auto const throughput = (double)s.output.size() / seconds;
 
-  info.bVisible = true;
-  SetConsoleCursorInfo(state().out_handle, &info);
+  s.vt_stats.throughput = s.vt_stats.throughput <= 0.0 ?
+    throughput : s.vt_stats.throughput * 0.8 + throughput * 0.2;
 }
 
-// is the cursor visible?
-inline bool cursor_enabled() {
-  CONSOLE_CURSOR_INFO info;
-  GetConsoleCursorInfo(state().out_handle, &info);
-  return info.bVisible;
-}
+// hash the frame that was just flushed without vt output, for needs_flush()
+inline void hash_flushed() {
+  auto& s = state();
 
-// make it so you cant highlight stuff in the console
-inline void disable_highlighting() {
-  DWORD mode;
-  GetConsoleMode(state().in_handle, &mode);
-  SetConsoleMode(impl::state().in_handle,
-    (mode & ~ENABLE_QUICK_EDIT_MODE) | ENABLE_EXTENDED_FLAGS);
+  s.presented_hashes.resize((size_t)s.size.y);
+  for (int y = 0; y < s.size.y; ++y)
+    s.presented_hashes[y] = hash_row(&s.backbuffer[(size_t)y * s.size.x], s.size.x);
+
+  s.presented_size = s.size;
 }
 
-// enable highlighting
-inline void enable_highlighting() {
-  DWORD mode;
-  GetConsoleMode(state().in_handle, &mode);
-  SetConsoleMode(impl::state().in_handle, 
-    (mode | ENABLE_QUICK_EDIT_MODE) | ENABLE_EXTENDED_FLAGS);
+// unregister a flush hook from a specific context, for objects that might
+// be destroyed while a different one is current
+inline void remove_flush_hook(context_state& s, int const id) {
+  auto& hooks = s.flush_hooks;
+  hooks.erase(std::remove_if(begin(hooks), end(hooks),
+    [id](auto const& h) { return h.first == id; }), end(hooks));
 }
 
-// is highlighting currently enabled
-inline bool highlighting_enabled() {
-  DWORD mode;
-  GetConsoleMode(state().in_handle, &mode);
-  return (mode & ENABLE_EXTENDED_FLAGS) && (mode & ENABLE_QUICK_EDIT_MODE);
+// everything that happens between two frames
+inline void end_frame() {
+  auto& s = state();
+
+  // everything allocated for this frame is done with
+  s.arena.reset();
+
+  // pick up any changes the user made to the window size
+  if (s.resizable)
+    detect_resize();
+
+  // resize between frames so the next one is drawn at the new size
+  if (auto const pending = s.pending_size; pending.x > 0) {
+    term::size(pending);
+
+    if (s.resize_callback)
+      s.resize_callback(pending);
+  }
 }
 
 } // namespace impl
@@ -299,11 +2131,8 @@ inline void initialize() {
   // seems kinda reduntant, but basically just removes the scrollbar
   size({ info.srWindow.Right + 1, info.srWindow.Bottom + 1 });
 
-  auto const window = GetConsoleWindow();
-
   // prevent resizing the console window
-  SetWindowLong(window, GWL_STYLE, GetWindowLong(
-    window, GWL_STYLE) & ~(WS_MAXIMIZEBOX | WS_SIZEBOX));
+  impl::set_resizable(false);
 }
 
 // write the backbuffer to the console window
@@ -312,52 +2141,78 @@ inline void flush() {
     0, 0, (short)impl::state().size.x, (short)impl::state().size.y
   };
 
-  // write to console
-  WriteConsoleOutput(
-    impl::state().out_handle,
-    impl::state().backbuffer.get(),
-    { region.Right, region.Bottom },
-    { 0, 0 }, &region);
+  // write to console (unless this context is headless)
+  if (impl::state().out_handle && impl::state().vt_output)
+    impl::present_vt();
+  else if (impl::state().out_handle) {
+    WriteConsoleOutput(
+      impl::state().out_handle,
+      impl::state().backbuffer.get(),
+      { region.Right, region.Bottom },
+      { 0, 0 }, &region);
+  }
+
+  // remember what was flushed for needs_flush(), vt output already does
+  if (!(impl::state().out_handle && impl::state().vt_output) && impl::state().hash_flushed)
+    impl::hash_flushed();
+
+  for (auto const& [id, hook] : impl::state().flush_hooks)
+    hook(impl::state().backbuffer.get(), impl::state().size);
+
+  impl::end_frame();
 }
 
-// resize the console window and clear the backbuffer
-inline void size(vec2 const& size) {
-  impl::state().size = size;
+// whether flushing would write anything
+inline bool needs_flush() {
+  auto& s = impl::state();
+  auto const vt = s.out_handle && s.vt_output;
 
-  auto const num_chars = (size_t)size.x * (size_t)size.y;
-  assert(num_chars > 0);
+  // cells that went out with reduced colors have to be written again
+  if (vt && s.reduced_cells > 0)
+    return true;
 
-  // allocate the backbuffer
-  impl::state().backbuffer = std::make_unique<CHAR_INFO[]>(num_chars);
+  if (!vt)
+    s.hash_flushed = true;
 
-  // zero memory
-  memset(impl::state().backbuffer.get(), 0, num_chars * sizeof(CHAR_INFO));
+  if (s.presented_size.x != s.size.x || s.presented_size.y != s.size.y ||
+      s.presented_hashes.size() != (size_t)s.size.y)
+    return true;
 
-  SMALL_RECT const rect{
-    0, 0, (short)size.x - 1, (short)size.y - 1
-  };
+  // presented only has the rows that were actually written, so rows that
+  // bandwidth_aware output put off still differ from the backbuffer
+  for (int y = 0; y < s.size.y; ++y) {
+    auto const row = &s.backbuffer[(size_t)y * s.size.x];
+    if (impl::hash_row(row, s.size.x) != s.presented_hashes[y])
+      return true;
+  }
 
-  // the following code is super retarded but it's needed (i think)
-  // just read the remarks section in the following pages
-  // https://docs.microsoft.com/en-us/windows/console/setconsolewindowinfo
-  // https://docs.microsoft.com/en-us/windows/console/setconsolescreenbuffersize
+  return false;
+}
 
-  CONSOLE_SCREEN_BUFFER_INFO info;
-  GetConsoleScreenBufferInfo(impl::state().out_handle, &info);
+// finish a frame without writing anything to the console
+inline void skip_frame() {
+  impl::end_frame();
+}
+
+// resize the console window and clear the backbuffer
+inline void size(vec2 const& size) {
+  impl::resize_backbuffer(size);
 
-  // too wide
-  if (rect.Right > info.dwMaximumWindowSize.X)
-    SetConsoleScreenBufferSize(impl::state().out_handle, { (short)size.x, info.dwSize.Y });
+  if (impl::state().out_handle)
+    impl::resize_console(size);
 
-  GetConsoleScreenBufferInfo(impl::state().out_handle, &info);
+  // this resize supersedes any earlier request
+  impl::state().pending_size = { 0, 0 };
+}
 
-  // too tall
-  if (rect.Bottom > info.dwMaximumWindowSize.Y)
-    SetConsoleScreenBufferSize(impl::state().out_handle, { info.dwSize.X, (short)size.y });
+// resize the console window after the next flush
+inline void request_size(vec2 const& size) {
+  impl::state().pending_size = size;
+}
 
-  // resize the actual console window
-  SetConsoleWindowInfo(impl::state().out_handle, TRUE, &rect);
-  SetConsoleScreenBufferSize(impl::state().out_handle, { (short)size.x, (short)size.y });
+// called after the backbuffer was resized between frames
+inline void on_resize(std::function<void(vec2 const& size)> callback) {
+  impl::state().resize_callback = std::move(callback);
 }
 
 // get the size of the console (measured in characters)
@@ -413,6 +2268,18 @@ inline void enable(option const opt) {
   case highlighting:
     impl::enable_highlighting();
     break;
+  case preserve_on_resize:
+    impl::state().preserve_on_resize = true;
+    break;
+  case resizable:
+    impl::set_resizable(true);
+    break;
+  case vt_output:
+    impl::set_vt_output(true);
+    break;
+  case bandwidth_aware:
+    impl::state().bandwidth_aware = true;
+    break;
   }
 }
 
@@ -425,6 +2292,18 @@ inline void disable(option const opt) {
   case highlighting:
     impl::disable_highlighting();
     break;
+  case preserve_on_resize:
+    impl::state().preserve_on_resize = false;
+    break;
+  case resizable:
+    impl::set_resizable(false);
+    break;
+  case vt_output:
+    impl::set_vt_output(false);
+    break;
+  case bandwidth_aware:
+    impl::state().bandwidth_aware = false;
+    break;
   }
 }
 
@@ -435,6 +2314,14 @@ inline bool enabled(option const opt) {
     return impl::cursor_enabled();
   case highlighting:
     return impl::highlighting_enabled();
+  case preserve_on_resize:
+    return impl::state().preserve_on_resize;
+  case resizable:
+    return impl::state().resizable;
+  case vt_output:
+    return impl::state().vt_output;
+  case bandwidth_aware:
+    return impl::state().bandwidth_aware;
   }
 
   return false;
@@ -457,31 +2344,28 @@ inline void clear() {
 
 // fill the console with a single character
 inline void fill(attribute const attrib, wchar_t const c) {
-  // loop through every character and assign it our attribute and char
-  for (size_t i = 0; i <
-      (size_t)impl::state().size.x * (size_t)impl::state().size.y; ++i) {
-    impl::state().backbuffer[i] = {
-      c, *(uint16_t*)&attrib
-    };
-  }
+  auto& state = impl::state();
+
+  // every cell gets the same value, which compiles down to wide stores
+  std::fill(state.backbuffer.get(), state.backbuffer.get() +
+    (size_t)state.size.x * (size_t)state.size.y, CHAR_INFO{ c, attrib.value });
 }
 
 // render a horizontal line
 inline void hline(int const ypos, attribute const attrib, wchar_t const c) {
-  for (int i = 0; i < impl::state().size.x; ++i) {
-    impl::state().backbuffer[i + (size_t)ypos * impl::state().size.x] = {
-      c, *(uint16_t*)&attrib
-    };
-  }
+  auto& state = impl::state();
+  auto const row = &state.backbuffer[(size_t)ypos * state.size.x];
+
+  std::fill(row, row + state.size.x, CHAR_INFO{ c, attrib.value });
 }
 
 // render a vertical line
 inline void vline(int const xpos, attribute const attrib, wchar_t const c) {
-  for (int i = 0; i < impl::state().size.y; ++i) {
-    impl::state().backbuffer[xpos + i * impl::state().size.x] = {
-      c, *(uint16_t*)&attrib
-    };
-  }
+  auto& state = impl::state();
+  CHAR_INFO const cell = { c, attrib.value };
+
+  for (int i = 0; i < state.size.y; ++i)
+    state.backbuffer[xpos + (size_t)i * state.size.x] = cell;
 }
 
 // render a single character to the console
@@ -494,10 +2378,23 @@ inline void character(vec2 const& position, attribute const attrib, wchar_t cons
   assert(position.y >= 0 && position.y < impl::state().size.y);
 
   impl::state().backbuffer[index] = {
-    c, *(uint16_t*)&attrib
+    c, attrib.value
   };
 }
 
+// copy a block of cells from a surface to the console
+inline void blit(surface const& src, rect const& src_rect,
+    vec2 const& position, int const flags) {
+  impl::blit(src, src_rect, position, nullptr, flags);
+}
+
+// copy a block of cells from a surface to the console, skipping every cell
+// that is identical to transparent
+inline void blit(surface const& src, rect const& src_rect, vec2 const& position,
+    CHAR_INFO const& transparent, int const flags) {
+  impl::blit(src, src_rect, position, &transparent, flags);
+}
+
 // render a string to the console
 template <typename ...Args>
 inline std::pair<int, int> string(vec2 const& position, attribute const attrib,
@@ -511,8 +2408,12 @@ inline std::pair<int, int> string(vec2 const& position, attribute const attrib,
   // maybe the buffer is too small
   assert(swprintf_s_return_value != -1);
 
+  // nothing to render if formatting failed
+  auto const length = swprintf_s_return_value < 0 ? 0 : (size_t)swprintf_s_return_value;
+
   // forward to real function
-  return impl::string(position, attrib, false, buffer);
+  return impl::string(position, attrib, false,
+    std::wstring_view(buffer, length));
 }
 
 // render a horizontally centered string to the console
@@ -528,8 +2429,12 @@ inline std::pair<int, int> stringc(vec2 const& position, attribute const attrib,
   // maybe the buffer is too small
   assert(swprintf_s_return_value != -1);
 
+  // nothing to render if formatting failed
+  auto const length = swprintf_s_return_value < 0 ? 0 : (size_t)swprintf_s_return_value;
+
   // forward to real function
-  return impl::string(position, attrib, true, buffer);
+  return impl::string(position, attrib, true,
+    std::wstring_view(buffer, length));
 }
 
 // the length of a string after formatting is applied
@@ -544,10 +2449,152 @@ inline size_t string_len(wchar_t const* const format, Args&& ...args) {
   // maybe the buffer is too small
   assert(swprintf_s_return_value != -1);
 
+  // nothing to render if formatting failed
+  auto const length = swprintf_s_return_value < 0 ? 0 : (size_t)swprintf_s_return_value;
+
+  // forward to real function
+  return impl::string_length(
+    std::wstring_view(buffer, length));
+}
+
+// render a wide string to the console (no printf-style formatting)
+inline std::pair<int, int> string(vec2 const& position,
+    attribute const attrib, std::wstring_view const str) {
+  return impl::string(position, attrib, false, str);
+}
+
+// render a horizontally centered wide string (no printf-style formatting)
+inline std::pair<int, int> stringc(vec2 const& position,
+    attribute const attrib, std::wstring_view const str) {
+  return impl::string(position, attrib, true, str);
+}
+
+// the length of a wide string after color formatting has been removed
+inline size_t string_len(std::wstring_view const str) {
+  return impl::string_length(str);
+}
+
+// render a utf-8 string to the console
+template <typename ...Args>
+inline std::pair<int, int> string(vec2 const& position, attribute const attrib,
+    char const* const format, Args&& ...args) {
+  char buffer[1024];
+
+  // format our string
+  auto const sprintf_s_return_value = sprintf_s(
+    buffer, format, std::forward<Args>(args)...);
+
+  // maybe the buffer is too small
+  assert(sprintf_s_return_value != -1);
+
+  // nothing to render if formatting failed
+  auto const length = sprintf_s_return_value < 0 ? 0 : (size_t)sprintf_s_return_value;
+
+  // forward to real function
+  return impl::string(position, attrib, false,
+    std::string_view(buffer, length));
+}
+
+// render a utf-8 string to the console (no printf-style formatting)
+inline std::pair<int, int> string(vec2 const& position,
+    attribute const attrib, std::string_view const str) {
+  return impl::string(position, attrib, false, str);
+}
+
+// render a horizontally centered utf-8 string to the console
+template <typename ...Args>
+inline std::pair<int, int> stringc(vec2 const& position, attribute const attrib,
+    char const* const format, Args&& ...args) {
+  char buffer[1024];
+
+  // format our string
+  auto const sprintf_s_return_value = sprintf_s(
+    buffer, format, std::forward<Args>(args)...);
+
+  // maybe the buffer is too small
+  assert(sprintf_s_return_value != -1);
+
+  // nothing to render if formatting failed
+  auto const length = sprintf_s_return_value < 0 ? 0 : (size_t)sprintf_s_return_value;
+
+  // forward to real function
+  return impl::string(position, attrib, true,
+    std::string_view(buffer, length));
+}
+
+// render a horizontally centered utf-8 string (no printf-style formatting)
+inline std::pair<int, int> stringc(vec2 const& position,
+    attribute const attrib, std::string_view const str) {
+  return impl::string(position, attrib, true, str);
+}
+
+// the length of a utf-8 string after formatting is applied
+template <typename ...Args>
+inline size_t string_len(char const* const format, Args&& ...args) {
+  char buffer[1024];
+
+  // format our string
+  auto const sprintf_s_return_value = sprintf_s(
+    buffer, format, std::forward<Args>(args)...);
+
+  // maybe the buffer is too small
+  assert(sprintf_s_return_value != -1);
+
+  // nothing to render if formatting failed
+  auto const length = sprintf_s_return_value < 0 ? 0 : (size_t)sprintf_s_return_value;
+
   // forward to real function
-  return impl::string_length(buffer);
+  return impl::string_length(
+    std::string_view(buffer, length));
+}
+
+// the length of a utf-8 string after color formatting has been removed
+inline size_t string_len(std::string_view const str) {
+  return impl::string_length(str);
+}
+
+#ifdef __cpp_char8_t
+
+// u8"" literals are forwarded to the utf-8 overloads above
+
+template <typename ...Args>
+inline std::pair<int, int> string(vec2 const& position, attribute const attrib,
+    char8_t const* const format, Args&& ...args) {
+  return string(position, attrib, 
+    (char const*)format, std::forward<Args>(args)...);
+}
+
+inline std::pair<int, int> string(vec2 const& position,
+    attribute const attrib, std::u8string_view const str) {
+  return impl::string(position, attrib, false,
+    std::string_view((char const*)str.data(), str.size()));
+}
+
+template <typename ...Args>
+inline std::pair<int, int> stringc(vec2 const& position, attribute const attrib,
+    char8_t const* const format, Args&& ...args) {
+  return stringc(position, attrib,
+    (char const*)format, std::forward<Args>(args)...);
+}
+
+inline std::pair<int, int> stringc(vec2 const& position,
+    attribute const attrib, std::u8string_view const str) {
+  return impl::string(position, attrib, true,
+    std::string_view((char const*)str.data(), str.size()));
+}
+
+template <typename ...Args>
+inline size_t string_len(char8_t const* const format, Args&& ...args) {
+  return string_len((char const*)format, std::forward<Args>(args)...);
 }
 
+inline size_t string_len(std::u8string_view const str) {
+  return impl::string_length(
+    std::string_view((char const*)str.data(), str.size()));
+}
+
+#endif // __cpp_char8_t
+
 // get user input
 template <typename T>
 inline bool input(vec2 position, T& value) {
@@ -600,4 +2647,141 @@ inline bool input(vec2 position, T& value) {
   return true;
 }
 
+// register a function that gets called after every flush
+inline int add_flush_hook(flush_hook hook) {
+  auto const id = impl::state().next_flush_hook_id++;
+  impl::state().flush_hooks.emplace_back(id, std::move(hook));
+  return id;
+}
+
+// unregister a flush hook
+inline void remove_flush_hook(int const id) {
+  impl::remove_flush_hook(impl::state(), id);
+}
+
+// get the per-frame arena usage
+inline arena_stats frame_arena_stats() {
+  return impl::state().arena.stats;
+}
+
+// get what flushing has written to the console
+inline output_stats vt_output_stats() {
+  return impl::state().vt_stats;
+}
+
+// split the screen into regions by importance
+inline int add_region(rect const& area, int const priority, int const interval) {
+  auto& s = impl::state();
+  s.regions.push_back({ s.next_region_id++, area, priority, (std::max)(interval, 1) });
+  return s.regions.back().id;
+}
+
+// remove a region that was added with add_region()
+inline void remove_region(int const id) {
+  auto& regions = impl::state().regions;
+  regions.erase(std::remove_if(begin(regions), end(regions),
+    [id](auto const& r) { return r.id == id; }), end(regions));
+}
+
+// the region the user is interacting with
+inline void focus_region(int const id) {
+  impl::state().focused_region = id;
+}
+
+// assume the output can only take this many bytes per second
+inline void bandwidth_limit(size_t const bytes_per_second) {
+  impl::state().bandwidth_limit = bytes_per_second;
+}
+
+// split finding what changed since the last frame across threads
+inline void diff_threads(unsigned const threads) {
+  auto& s = impl::state();
+  s.diff_threads = (std::max)(threads, 1u);
+
+  // the threads are started the next time they're needed
+  if (s.diff_threads == 1)
+    s.diff_pool.reset();
+}
+
+// allocate memory that stays valid until the next flush
+inline void* frame_alloc(size_t const size, size_t const alignment) {
+  return impl::state().arena.allocate(size, alignment);
+}
+
+// format a string into memory that stays valid until the next flush
+template <typename ...Args>
+inline std::wstring_view format(wchar_t const* const format, Args&& ...args) {
+  // measure first so the string can be formatted in place
+  auto const length = _scwprintf(format, args...);
+  assert(length >= 0);
+
+  auto const buffer = (wchar_t*)frame_alloc(
+    ((size_t)length + 1) * sizeof(wchar_t), alignof(wchar_t));
+
+  swprintf_s(buffer, (size_t)length + 1, format, std::forward<Args>(args)...);
+  return std::wstring_view(buffer, (size_t)length);
+}
+
+// format a utf-8 string into memory that stays valid until the next flush
+template <typename ...Args>
+inline std::string_view format(char const* const format, Args&& ...args) {
+  // measure first so the string can be formatted in place
+  auto const length = snprintf(nullptr, 0, format, args...);
+  assert(length >= 0);
+
+  auto const buffer = (char*)frame_alloc((size_t)length + 1, 1);
+
+  snprintf(buffer, (size_t)length + 1, format, std::forward<Args>(args)...);
+  return std::string_view(buffer, (size_t)length);
+}
+
+inline context::context(HANDLE const out_handle, HANDLE const in_handle)
+  : state_(std::make_unique<impl::context_state>()) {
+  state_->out_handle = out_handle;
+  state_->in_handle = in_handle;
+
+  // the info is garbage if this isn't a console screen buffer
+  vec2 window = { 80, 25 };
+
+  CONSOLE_SCREEN_BUFFER_INFO info;
+  if (GetConsoleScreenBufferInfo(out_handle, &info)) {
+    window = { info.srWindow.Right - info.srWindow.Left + 1,
+      info.srWindow.Bottom - info.srWindow.Top + 1 };
+  }
+
+  context_scope const scope(*this);
+  size(window);
+}
+
+inline context::context(HANDLE const out_handle,
+    HANDLE const in_handle, vec2 const& size)
+  : state_(std::make_unique<impl::context_state>()) {
+  state_->out_handle = out_handle;
+  state_->in_handle = in_handle;
+
+  context_scope const scope(*this);
+  impl::resize_backbuffer(size);
+}
+
+inline context::context(vec2 const& size)
+  : state_(std::make_unique<impl::context_state>()) {
+  context_scope const scope(*this);
+  impl::resize_backbuffer(size);
+}
+
+inline context::~context() {
+  // don't leave the thread pointing at a dead context
+  if (impl::current_state() == state_.get())
+    impl::current_state() = nullptr;
+}
+
+inline context_scope::context_scope(context& ctx)
+  : previous_(impl::current_state()) {
+  impl::current_state() = ctx.state_.get();
+}
+
+inline context_scope::~context_scope() {
+  impl::current_state() = previous_;
+}
+
 } // namespace term
\ No newline at end of file
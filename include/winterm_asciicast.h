@@ -0,0 +1,154 @@
+#pragma once
+
+#include "winterm_record.h"
+
+#include <ostream>
+
+
+namespace term {
+
+// writes frames as an asciicast v2 stream (https://asciinema.org)
+// every frame is converted into the vt sequences needed to turn the previous
+// frame into it, and written out as a single event line straight away
+class asciicast_writer {
+public:
+  explicit asciicast_writer(std::ostream& out);
+
+  // append a frame that was presented at a specific time (microseconds)
+  void frame(CHAR_INFO const* cells, vec2 const& size, uint64_t timestamp);
+
+private:
+  // write a single event line
+  void event(uint64_t timestamp, char type, std::string_view data);
+
+private:
+  std::ostream& out_;
+  bool header_written_ = false;
+
+  // the previous frame
+  std::vector<CHAR_INFO> previous_;
+  vec2 size_ = { 0, 0 };
+
+  impl::vt_encoder encoder_;
+
+  // reused between frames
+  std::string vt_, line_;
+};
+
+// convert a recording made by term::recorder into an asciicast v2 stream
+// only the current frame is kept in memory
+// returns false if the recording couldn't be read
+bool export_asciicast(std::filesystem::path const& path, std::ostream& out);
+
+
+//
+//
+// implmentation below
+//
+//
+
+
+namespace impl {
+
+// append a string as the contents of a json string literal
+inline void append_json(std::string& out, std::string_view const str) {
+  for (auto const c : str) {
+    switch (c) {
+    case '"':
+      out += "\\\"";
+      break;
+    case '\\':
+      out += "\\\\";
+      break;
+    case '\n':
+      out += "\\n";
+      break;
+    case '\r':
+      out += "\\r";
+      break;
+    default:
+      // control characters (the escape character, mostly)
+      if ((uint8_t)c < 0x20) {
+        char buffer[8];
+        snprintf(buffer, sizeof(buffer), "\\u%04x", (unsigned)c);
+        out += buffer;
+      }
+      else
+        out.push_back(c);
+    }
+  }
+}
+
+} // namespace impl
+
+inline asciicast_writer::asciicast_writer(std::ostream& out)
+  : out_(out) {}
+
+// append a frame that was presented at a specific time (microseconds)
+inline void asciicast_writer::frame(CHAR_INFO const* const cells,
+    vec2 const& size, uint64_t const timestamp) {
+  auto const count = (size_t)size.x * (size_t)size.y;
+  auto const resized = size.x != size_.x || size.y != size_.y;
+
+  if (!header_written_) {
+    char header[128];
+    snprintf(header, sizeof(header),
+      "{\"version\": 2, \"width\": %d, \"height\": %d}\n", size.x, size.y);
+
+    out_ << header;
+    header_written_ = true;
+  }
+  else if (resized) {
+    char dimensions[32];
+    snprintf(dimensions, sizeof(dimensions), "%dx%d", size.x, size.y);
+    event(timestamp, 'r', dimensions);
+  }
+
+  // a resize means we have no idea what's on the screen anymore
+  if (resized) {
+    encoder_.reset();
+    previous_.clear();
+  }
+
+  vt_.clear();
+  encoder_.encode(previous_.empty() ?
+    nullptr : previous_.data(), cells, size, vt_);
+
+  // nothing changed
+  if (!vt_.empty())
+    event(timestamp, 'o', vt_);
+
+  previous_.assign(cells, cells + count);
+  size_ = size;
+}
+
+// write a single event line
+inline void asciicast_writer::event(uint64_t const timestamp,
+    char const type, std::string_view const data) {
+  char prefix[48];
+  snprintf(prefix, sizeof(prefix), "[%llu.%06llu, \"%c\", \"",
+    (unsigned long long)(timestamp / 1000000),
+    (unsigned long long)(timestamp % 1000000), type);
+
+  line_ = prefix;
+  impl::append_json(line_, data);
+  line_ += "\"]\n";
+
+  out_.write(line_.data(), (std::streamsize)line_.size());
+}
+
+// convert a recording made by term::recorder into an asciicast v2 stream
+inline bool export_asciicast(std::filesystem::path const& path, std::ostream& out) {
+  recording rec(path);
+  if (!rec.is_open())
+    return false;
+
+  asciicast_writer writer(out);
+
+  while (rec.next())
+    writer.frame(rec.cells(), rec.size(), rec.timestamp());
+
+  return rec.frame() + 1 == rec.frames();
+}
+
+} // namespace term
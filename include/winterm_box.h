@@ -0,0 +1,256 @@
+#pragma once
+
+#include "winterm.h"
+
+
+namespace term {
+
+// the set of glyphs used to draw lines
+enum line_style {
+  line_single,  // thin lines
+  line_double,  // two thin lines
+  line_heavy,   // thick lines
+  line_rounded, // like line_single, with rounded corners
+  line_ascii    // - | and + (for fonts without box drawing characters)
+};
+
+// draw the outline of a rectangle (at least 2x2)
+// lines that are already on the screen in the same style are joined with,
+// so boxes that share an edge get proper junctions
+void box(rect const& area, attribute attrib, line_style style = line_single);
+
+// draw the outline of a rectangle and fill its inside with a character
+void box(rect const& area, attribute border, attribute inside,
+  wchar_t fill, line_style style = line_single);
+
+// draw a horizontal line length cells long, joining any lines it crosses
+void hline(vec2 const& position, int length, attribute attrib,
+  line_style style = line_single);
+
+// draw a vertical line length cells long, joining any lines it crosses
+void vline(vec2 const& position, int length, attribute attrib,
+  line_style style = line_single);
+
+// draw the rulings of a table
+// columns and rows are the sizes of the cells inside of the grid, the
+// rulings between them take up an extra character each
+void grid(vec2 const& position, std::vector<int> const& columns,
+  std::vector<int> const& rows, attribute attrib, line_style style = line_single);
+
+
+//
+//
+// implmentation below
+//
+//
+
+
+namespace impl {
+
+// the neighbours a line glyph connects to
+enum line_direction : uint8_t {
+  line_up    = 1 << 0,
+  line_right = 1 << 1,
+  line_down  = 1 << 2,
+  line_left  = 1 << 3
+};
+
+// the glyph for every combination of line directions
+inline wchar_t const* line_glyphs(line_style const style) {
+  static constexpr wchar_t glyphs[][16] = {
+    // single
+    { L' ', L'\u2502', L'\u2500', L'\u2514', L'\u2502', L'\u2502', L'\u250C', L'\u251C',
+      L'\u2500', L'\u2518', L'\u2500', L'\u2534', L'\u2510', L'\u2524', L'\u252C', L'\u253C' },
+    // double
+    { L' ', L'\u2551', L'\u2550', L'\u255A', L'\u2551', L'\u2551', L'\u2554', L'\u2560',
+      L'\u2550', L'\u255D', L'\u2550', L'\u2569', L'\u2557', L'\u2563', L'\u2566', L'\u256C' },
+    // heavy
+    { L' ', L'\u2503', L'\u2501', L'\u2517', L'\u2503', L'\u2503', L'\u250F', L'\u2523',
+      L'\u2501', L'\u251B', L'\u2501', L'\u253B', L'\u2513', L'\u252B', L'\u2533', L'\u254B' },
+    // rounded
+    { L' ', L'\u2502', L'\u2500', L'\u2570', L'\u2502', L'\u2502', L'\u256D', L'\u251C',
+      L'\u2500', L'\u256F', L'\u2500', L'\u2534', L'\u256E', L'\u2524', L'\u252C', L'\u253C' },
+    // ascii
+    { L' ', L'|', L'-', L'+', L'|', L'|', L'+', L'+',
+      L'-', L'+', L'-', L'+', L'+', L'+', L'+', L'+' }
+  };
+
+  return glyphs[style];
+}
+
+// the directions an existing glyph already connects to (0 if it isn't a line)
+inline uint8_t line_mask(wchar_t const c, wchar_t const* const glyphs) {
+  // most cells aren't part of a line, don't bother searching for those
+  if ((c < 0x2500 || c >= 0x2580) && c != L'|' && c != L'-' && c != L'+')
+    return 0;
+
+  // search backwards so that straight lines are found before line ends
+  for (uint8_t mask = 15; mask > 0; --mask) {
+    if (glyphs[mask] == c)
+      return mask;
+  }
+
+  return 0;
+}
+
+// draw a line glyph, joining it with whatever line is already in the cell
+inline void line_cell(CHAR_INFO& cell, uint8_t const mask,
+    uint16_t const attrib, wchar_t const* const glyphs) {
+  cell = { glyphs[mask | line_mask(cell.Char.UnicodeChar, glyphs)], attrib };
+}
+
+// draw a single row of a grid (either a ruling or the row of cells between
+// two rulings), clipped to the columns [first, last)
+// vertical are the directions every junction connects to, along with left
+// and right if this row is a ruling
+inline void grid_row(CHAR_INFO* const row, int x, std::vector<int> const& columns,
+    int const first, int const last, bool const ruling, uint8_t const vertical,
+    uint16_t const attrib, wchar_t const* const glyphs) {
+  for (size_t c = 0; c <= columns.size() && x < last; ++c) {
+    // the junction between two columns
+    if (x >= first) {
+      auto const left = c > 0 ? line_left : 0,
+        right = c < columns.size() ? line_right : 0;
+
+      line_cell(row[x], (uint8_t)(vertical |
+        (ruling ? left | right : 0)), attrib, glyphs);
+    }
+
+    x += 1;
+
+    if (c == columns.size())
+      break;
+
+    // the line between two junctions
+    if (ruling) {
+      auto const to = (std::min)(x + columns[c], last);
+
+      for (int i = (std::max)(x, first); i < to; ++i)
+        line_cell(row[i], line_left | line_right, attrib, glyphs);
+    }
+
+    x += columns[c];
+  }
+}
+
+} // namespace impl
+
+// draw the outline of a rectangle
+inline void box(rect const& area, attribute const attrib, line_style const style) {
+  if (area.width < 2 || area.height < 2)
+    return;
+
+  grid({ area.x, area.y }, { area.width - 2 }, { area.height - 2 }, attrib, style);
+}
+
+// draw the outline of a rectangle and fill its inside with a character
+inline void box(rect const& area, attribute const border, attribute const inside,
+    wchar_t const fill, line_style const style) {
+  auto const console = impl::state().size;
+
+  // the inside, clipped to the console
+  auto const first = (std::max)(0, area.x + 1),
+    last = (std::min)(console.x, area.x + area.width - 1);
+
+  auto const top = (std::max)(0, area.y + 1),
+    bottom = (std::min)(console.y, area.y + area.height - 1);
+
+  if (first < last) {
+    CHAR_INFO const cell = { fill, inside.value };
+
+    for (int y = top; y < bottom; ++y) {
+      auto const row = &impl::state().backbuffer[(size_t)y * console.x];
+      std::fill(row + first, row + last, cell);
+    }
+  }
+
+  box(area, border, style);
+}
+
+// draw a horizontal line, joining any lines it crosses
+inline void hline(vec2 const& position, int const length,
+    attribute const attrib, line_style const style) {
+  auto const console = impl::state().size;
+
+  if (position.y < 0 || position.y >= console.y)
+    return;
+
+  auto const glyphs = impl::line_glyphs(style);
+  auto const row = &impl::state().backbuffer[(size_t)position.y * console.x];
+  auto const last = (std::min)(console.x, position.x + length);
+
+  for (int x = (std::max)(0, position.x); x < last; ++x) {
+    impl::line_cell(row[x], (uint8_t)((x > position.x ? impl::line_left : 0) |
+      (x + 1 < position.x + length ? impl::line_right : 0)),
+      attrib.value, glyphs);
+  }
+}
+
+// draw a vertical line, joining any lines it crosses
+inline void vline(vec2 const& position, int const length,
+    attribute const attrib, line_style const style) {
+  auto const console = impl::state().size;
+
+  if (position.x < 0 || position.x >= console.x)
+    return;
+
+  auto const glyphs = impl::line_glyphs(style);
+  auto const last = (std::min)(console.y, position.y + length);
+
+  for (int y = (std::max)(0, position.y); y < last; ++y) {
+    impl::line_cell(impl::state().backbuffer[(size_t)y * console.x + position.x],
+      (uint8_t)((y > position.y ? impl::line_up : 0) |
+      (y + 1 < position.y + length ? impl::line_down : 0)),
+      attrib.value, glyphs);
+  }
+}
+
+// draw the rulings of a table
+inline void grid(vec2 const& position, std::vector<int> const& columns,
+    std::vector<int> const& rows, attribute const attrib, line_style const style) {
+  auto const console = impl::state().size;
+  auto const glyphs = impl::line_glyphs(style);
+
+  // the total width, including rulings
+  auto width = 1;
+  for (auto const c : columns)
+    width += c + 1;
+
+  // clip horizontally once, every row shares it
+  auto const first = (std::max)(0, position.x),
+    last = (std::min)(console.x, position.x + width);
+
+  if (first >= last)
+    return;
+
+  auto y = position.y;
+
+  auto const row = [&](bool const ruling, uint8_t const vertical) {
+    if (y >= 0 && y < console.y) {
+      impl::grid_row(&impl::state().backbuffer[(size_t)y * console.x],
+        position.x, columns, first, last, ruling, vertical,
+        attrib.value, glyphs);
+    }
+
+    y += 1;
+  };
+
+  for (size_t r = 0; r <= rows.size() && y < console.y; ++r) {
+    // the ruling above every row, and below the last one
+    row(true, (uint8_t)((r > 0 ? impl::line_up : 0) |
+      (r < rows.size() ? impl::line_down : 0)));
+
+    if (r == rows.size())
+      break;
+
+    // skip straight past rows that are above the console
+    auto const height = rows[r];
+    auto const skip = (std::min)(height, (std::max)(0, -y));
+    y += skip;
+
+    for (int i = skip; i < height && y < console.y; ++i)
+      row(false, impl::line_up | impl::line_down);
+  }
+}
+
+} // namespace term
@@ -0,0 +1,301 @@
+#pragma once
+
+#include "winterm.h"
+
+
+namespace term {
+
+// how a single terminal is keeping up
+struct sink_stats {
+  // frames written, and frames skipped because the previous write was
+  // still in progress
+  size_t frames = 0,
+    dropped = 0;
+
+  // bytes written
+  size_t bytes = 0;
+};
+
+// sends every flushed frame (of the context that is current when it's
+// created, which has to outlive it) to any number of terminals as vt sequences
+// (pipes, sockets or pseudo consoles, for example), so the same screen can
+// be served to many sessions while only being rendered once
+// terminals that received every frame share a single encoding of the
+// changes, one that fell behind gets the difference between the last frame
+// it received and the current one
+// writing never blocks: a terminal whose previous write hasn't completed yet
+// skips frames until it has
+class broadcaster {
+public:
+  broadcaster();
+  ~broadcaster();
+
+  broadcaster(broadcaster const&) = delete;
+  broadcaster& operator=(broadcaster const&) = delete;
+
+  // start sending frames to a terminal, starting with a full repaint
+  // the handle has to be opened for overlapped io (FILE_FLAG_OVERLAPPED) and
+  // is not closed by the broadcaster
+  // returns an id that can be passed to remove()
+  int add(HANDLE handle);
+
+  // stop sending frames to a terminal (waits up to a quarter of a second for
+  // its last write to finish, a write that takes longer than that is cancelled)
+  void remove(int id);
+
+  // the number of terminals, ones that failed to be written to are removed
+  size_t sinks() const;
+
+  // how a terminal is keeping up, null if it was removed
+  sink_stats const* stats(int id) const;
+
+private:
+  struct sink {
+    int id;
+    HANDLE handle;
+
+    // the write that is in progress, if writing is true
+    OVERLAPPED overlapped;
+    bool writing = false;
+    bool failed = false;
+
+    // the bytes being written, they have to stay alive until it's done
+    std::string buffer;
+
+    // true if this terminal received the last frame, otherwise it has its
+    // own copy of the last frame it did receive
+    bool in_sync = false;
+    std::vector<CHAR_INFO> previous;
+    vec2 size = { 0, 0 };
+
+    impl::vt_encoder encoder;
+    sink_stats stats;
+  };
+
+  // send a frame to every terminal that isn't busy
+  void broadcast(CHAR_INFO const* cells, vec2 const& size);
+
+  // is the terminal done with its previous write?
+  bool ready(sink& s);
+
+  // start writing the terminal's buffer
+  void write(sink& s);
+
+  // wait for a terminal's write to finish, or cancel it if it doesn't in
+  // time, and free it
+  void close(sink& s);
+
+private:
+  std::vector<std::unique_ptr<sink>> sinks_;
+  int next_id_ = 0;
+
+  // the hook is removed from the context it was added to, whichever one is
+  // current when this is destroyed
+  impl::context_state* context_ = nullptr;
+  int hook_ = -1;
+
+  // the last frame, and the changes from it to the current one (encoded
+  // only if a terminal that is in sync needs them)
+  std::vector<CHAR_INFO> previous_;
+  vec2 size_ = { 0, 0 };
+
+  impl::vt_encoder encoder_;
+  std::string shared_;
+};
+
+
+//
+//
+// implmentation below
+//
+//
+
+
+inline broadcaster::broadcaster() {
+  context_ = &impl::state();
+  hook_ = add_flush_hook([this](CHAR_INFO const* const cells, vec2 const& size) {
+    broadcast(cells, size);
+  });
+}
+
+inline broadcaster::~broadcaster() {
+  impl::remove_flush_hook(*context_, hook_);
+
+  for (auto& s : sinks_)
+    close(*s);
+}
+
+// start sending frames to a terminal
+inline int broadcaster::add(HANDLE const handle) {
+  auto s = std::make_unique<sink>();
+  s->id = next_id_++;
+  s->handle = handle;
+  s->overlapped = {};
+  s->overlapped.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+
+  sinks_.push_back(std::move(s));
+  return sinks_.back()->id;
+}
+
+// stop sending frames to a terminal
+inline void broadcaster::remove(int const id) {
+  auto const it = std::find_if(begin(sinks_), end(sinks_),
+    [id](auto const& s) { return s->id == id; });
+
+  if (it == end(sinks_))
+    return;
+
+  close(**it);
+  sinks_.erase(it);
+}
+
+// the number of terminals
+inline size_t broadcaster::sinks() const {
+  return sinks_.size();
+}
+
+// how a terminal is keeping up
+inline sink_stats const* broadcaster::stats(int const id) const {
+  for (auto const& s : sinks_) {
+    if (s->id == id)
+      return &s->stats;
+  }
+
+  return nullptr;
+}
+
+// send a frame to every terminal that isn't busy
+inline void broadcaster::broadcast(CHAR_INFO const* const cells, vec2 const& size) {
+  auto const count = (size_t)size.x * (size_t)size.y;
+  auto const resized = size.x != size_.x || size.y != size_.y;
+
+  // the shared encoding is done at most once per frame
+  auto encoded = false;
+
+  for (auto& ptr : sinks_) {
+    auto& s = *ptr;
+
+    if (!ready(s)) {
+      // it's falling behind, keep the last frame it got so it can catch up
+      // later on with a single diff
+      if (s.in_sync) {
+        s.previous = previous_;
+        s.size = size_;
+        s.in_sync = false;
+      }
+
+      s.stats.dropped += 1;
+      continue;
+    }
+
+    if (s.failed)
+      continue;
+
+    if (s.in_sync && !resized) {
+      if (!encoded) {
+        // every encoding starts from scratch (cursor and colors unknown), so
+        // terminals that were out of sync can share it as soon as they
+        // catch up
+        shared_.clear();
+        encoder_.reset();
+        encoder_.encode(previous_.data(), cells, size, shared_);
+        encoded = true;
+      }
+
+      s.buffer.assign(shared_);
+    }
+    else {
+      s.buffer.clear();
+      s.encoder.reset();
+
+      // a new terminal, or the size changed since the last frame it got
+      if (s.previous.empty() || s.size.x != size.x || s.size.y != size.y) {
+        s.buffer += "\x1b[0m\x1b[2J";
+        s.encoder.encode(nullptr, cells, size, s.buffer);
+      }
+      else
+        s.encoder.encode(s.previous.data(), cells, size, s.buffer);
+
+      // caught up, the memory is kept for the next time it falls behind
+      s.previous.clear();
+      s.in_sync = true;
+    }
+
+    s.stats.frames += 1;
+
+    // nothing changed
+    if (!s.buffer.empty())
+      write(s);
+  }
+
+  // drop the terminals that can't be written to anymore
+  for (auto& s : sinks_) {
+    if (s->failed)
+      close(*s);
+  }
+
+  sinks_.erase(std::remove_if(begin(sinks_), end(sinks_),
+    [](auto const& s) { return s->failed; }), end(sinks_));
+
+  previous_.assign(cells, cells + count);
+  size_ = size;
+}
+
+// is the terminal done with its previous write?
+inline bool broadcaster::ready(sink& s) {
+  if (!s.writing)
+    return true;
+
+  DWORD written;
+  if (!GetOverlappedResult(s.handle, &s.overlapped, &written, FALSE)) {
+    if (GetLastError() == ERROR_IO_INCOMPLETE)
+      return false;
+
+    s.failed = true;
+  }
+
+  s.writing = false;
+  return true;
+}
+
+// start writing the terminal's buffer
+inline void broadcaster::write(sink& s) {
+  auto const event = s.overlapped.hEvent;
+  s.overlapped = {};
+  s.overlapped.hEvent = event;
+
+  // an overlapped write to a pipe only completes once every byte was
+  // written, so there are no partial writes to pick up after
+  if (!WriteFile(s.handle, s.buffer.data(), (DWORD)s.buffer.size(),
+      nullptr, &s.overlapped) && GetLastError() != ERROR_IO_PENDING) {
+    s.failed = true;
+    return;
+  }
+
+  s.writing = true;
+  s.stats.bytes += s.buffer.size();
+}
+
+// wait for a terminal's write to finish, or cancel it if it doesn't in
+// time, and free it
+inline void broadcaster::close(sink& s) {
+  // milliseconds, long enough for a frame to reach a terminal that is still
+  // reading, short enough that one that stopped doesn't hang the caller
+  constexpr DWORD timeout = 250;
+
+  if (s.writing) {
+    if (WaitForSingleObject(s.overlapped.hEvent, timeout) != WAIT_OBJECT_0)
+      CancelIoEx(s.handle, &s.overlapped);
+
+    DWORD written;
+    GetOverlappedResult(s.handle, &s.overlapped, &written, TRUE);
+    s.writing = false;
+  }
+
+  if (s.overlapped.hEvent) {
+    CloseHandle(s.overlapped.hEvent);
+    s.overlapped.hEvent = nullptr;
+  }
+}
+
+} // namespace term
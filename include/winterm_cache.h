@@ -0,0 +1,328 @@
+#pragma once
+
+#include "winterm.h"
+
+#include <list>
+#include <unordered_map>
+
+
+namespace term {
+
+// how well a string cache is doing
+struct string_cache_stats {
+  // strings that were copied from the cache, and ones that had to be
+  // formatted and laid out
+  size_t hits = 0,
+    misses = 0;
+
+  // strings that were thrown out to make room for new ones
+  size_t evictions = 0;
+
+  // what is currently cached
+  size_t entries = 0,
+    cells = 0;
+
+  // the fraction of strings that were copied from the cache
+  double hit_rate() const {
+    return hits + misses == 0 ? 0.0 : (double)hits / (double)(hits + misses);
+  }
+};
+
+// remembers what strings look like once they're formatted and laid out, so
+// labels that are drawn with the same format, arguments and attribute every
+// frame are just copied into the backbuffer
+// strings are looked up by a hash of the format string and arguments (string
+// arguments by their contents), and a hit is only taken once those match the
+// ones the string was cached with, the least recently used strings are thrown
+// out once the cache holds more than max_cells cells
+class string_cache {
+public:
+  explicit string_cache(size_t max_cells = 64 * 1024);
+
+  // render a string to the console, same as term::string()
+  // returns the start and end position of the string
+  template <typename ...Args>
+  std::pair<int, int> string(vec2 const& position,
+    attribute attrib, wchar_t const* format, Args&& ...args);
+
+  // render a utf-8 string to the console, same as term::string()
+  template <typename ...Args>
+  std::pair<int, int> string(vec2 const& position,
+    attribute attrib, char const* format, Args&& ...args);
+
+  // render a horizontally centered string to the console, same as term::stringc()
+  template <typename ...Args>
+  std::pair<int, int> stringc(vec2 const& position,
+    attribute attrib, wchar_t const* format, Args&& ...args);
+
+  // render a horizontally centered utf-8 string, same as term::stringc()
+  template <typename ...Args>
+  std::pair<int, int> stringc(vec2 const& position,
+    attribute attrib, char const* format, Args&& ...args);
+
+  // throw out every cached string
+  void clear();
+
+  string_cache_stats const& stats() const;
+
+private:
+  struct key {
+    uint64_t source;
+    uint16_t attrib;
+
+    bool operator==(key const& other) const {
+      return source == other.source && attrib == other.attrib;
+    }
+  };
+
+  struct entry {
+    key k;
+
+    // the format string and arguments it was formatted from, two strings
+    // can hash the same so this is what a hit is checked against
+    std::string source;
+
+    // the laid out string, one cell per character
+    std::vector<CHAR_INFO> cells;
+  };
+
+  // look the string up, formatting it only if it isn't cached
+  template <typename Char, typename ...Args>
+  std::pair<int, int> render(vec2 const& position, attribute attrib,
+    bool centered, Char const* format, Args&& ...args);
+
+  // the hash of the whole key, which the index is keyed by
+  static uint64_t slot(key const& k);
+
+  // copy a laid out string into the backbuffer, same as impl::string()
+  static std::pair<int, int> draw(vec2 const& position, bool centered,
+    std::vector<CHAR_INFO> const& cells);
+
+private:
+  size_t max_cells_;
+
+  // most recently used first
+  std::list<entry> entries_;
+  std::unordered_map<uint64_t, std::list<entry>::iterator> index_;
+
+  // strings that don't fit in the cache are laid out here
+  std::vector<CHAR_INFO> uncached_;
+
+  // the format string and arguments of the string being looked up, kept
+  // around so it doesn't allocate every time
+  std::string source_;
+
+  string_cache_stats stats_;
+};
+
+
+//
+//
+// implmentation below
+//
+//
+
+
+namespace impl {
+
+// fnv-1a
+inline uint64_t hash_bytes(uint64_t h, void const* const data, size_t const size) {
+  auto const bytes = (uint8_t const*)data;
+
+  for (size_t i = 0; i < size; ++i)
+    h = (h ^ bytes[i]) * 0x100000001B3ull;
+
+  return h;
+}
+
+// append a printf argument to what a cached string is looked up by, strings
+// go in by their contents since the same buffer is usually reused for
+// different text
+template <typename T>
+inline void append_argument(std::string& source, T const& arg) {
+  using type = std::decay_t<T>;
+
+  if constexpr (std::is_same_v<type, char const*> || std::is_same_v<type, char*> ||
+      std::is_same_v<type, wchar_t const*> || std::is_same_v<type, wchar_t*>) {
+    using Char = std::remove_const_t<std::remove_pointer_t<type>>;
+    Char const* const str = arg;
+
+    // the length goes in as well so that ("ab", "c") and ("a", "bc") differ
+    auto length = SIZE_MAX;
+    if (str)
+      length = std::char_traits<Char>::length(str);
+
+    source.append((char const*)&length, sizeof(length));
+    if (str)
+      source.append((char const*)str, length * sizeof(Char));
+  }
+  else {
+    static_assert(std::is_trivially_copyable_v<type>,
+      "string_cache arguments have to be printf arguments");
+
+    type const value = arg;
+    source.append((char const*)&value, sizeof(value));
+  }
+}
+
+} // namespace impl
+
+inline string_cache::string_cache(size_t const max_cells)
+  : max_cells_(max_cells) {}
+
+// render a string to the console
+template <typename ...Args>
+inline std::pair<int, int> string_cache::string(vec2 const& position,
+    attribute const attrib, wchar_t const* const format, Args&& ...args) {
+  return render(position, attrib, false, format, std::forward<Args>(args)...);
+}
+
+// render a utf-8 string to the console
+template <typename ...Args>
+inline std::pair<int, int> string_cache::string(vec2 const& position,
+    attribute const attrib, char const* const format, Args&& ...args) {
+  return render(position, attrib, false, format, std::forward<Args>(args)...);
+}
+
+// render a horizontally centered string to the console
+template <typename ...Args>
+inline std::pair<int, int> string_cache::stringc(vec2 const& position,
+    attribute const attrib, wchar_t const* const format, Args&& ...args) {
+  return render(position, attrib, true, format, std::forward<Args>(args)...);
+}
+
+// render a horizontally centered utf-8 string to the console
+template <typename ...Args>
+inline std::pair<int, int> string_cache::stringc(vec2 const& position,
+    attribute const attrib, char const* const format, Args&& ...args) {
+  return render(position, attrib, true, format, std::forward<Args>(args)...);
+}
+
+// throw out every cached string
+inline void string_cache::clear() {
+  entries_.clear();
+  index_.clear();
+
+  stats_.entries = 0;
+  stats_.cells = 0;
+}
+
+inline string_cache_stats const& string_cache::stats() const {
+  return stats_;
+}
+
+// look the string up, formatting it only if it isn't cached
+template <typename Char, typename ...Args>
+inline std::pair<int, int> string_cache::render(vec2 const& position,
+    attribute const attrib, bool const centered, Char const* const format, Args&& ...args) {
+  source_.clear();
+  impl::append_argument(source_, format);
+  (impl::append_argument(source_, args), ...);
+
+  key const k = {
+    impl::hash_bytes(0xCBF29CE484222325ull, source_.data(), source_.size()),
+    attrib.value
+  };
+
+  auto const h = slot(k);
+
+  auto const it = index_.find(h);
+  if (it != end(index_) && it->second->k == k && it->second->source == source_) {
+    stats_.hits += 1;
+
+    // move it to the front, it's the most recently used now
+    entries_.splice(begin(entries_), entries_, it->second);
+    return draw(position, centered, it->second->cells);
+  }
+
+  stats_.misses += 1;
+
+  Char buffer[1024];
+
+  // format our string
+  int count;
+  if constexpr (std::is_same_v<Char, wchar_t>)
+    count = swprintf_s(buffer, format, std::forward<Args>(args)...);
+  else
+    count = sprintf_s(buffer, format, std::forward<Args>(args)...);
+
+  // maybe the buffer is too small
+  assert(count != -1);
+
+  // nothing to render if formatting failed, it isn't cached either
+  if (count < 0)
+    return { position.x, position.x - 1 };
+
+  std::basic_string_view<Char> const str(buffer, (size_t)count);
+  auto const length = impl::string_length(str);
+
+  // too big to ever fit, don't throw everything else out for it
+  if (length > max_cells_) {
+    uncached_.resize(length);
+    impl::layout(str, attrib, uncached_.data(), length, false);
+    return draw(position, centered, uncached_);
+  }
+
+  // a different string with the same hash, it gets replaced
+  if (it != end(index_)) {
+    stats_.cells -= it->second->cells.size();
+    stats_.entries -= 1;
+
+    entries_.erase(it->second);
+    index_.erase(it);
+  }
+
+  // make room for it
+  while (!entries_.empty() && stats_.cells + length > max_cells_) {
+    auto const& last = entries_.back();
+    stats_.cells -= last.cells.size();
+    stats_.entries -= 1;
+    stats_.evictions += 1;
+
+    index_.erase(slot(last.k));
+    entries_.pop_back();
+  }
+
+  entries_.push_front({ k, source_, std::vector<CHAR_INFO>(length) });
+  impl::layout(str, attrib, entries_.front().cells.data(), length, false);
+
+  index_[h] = begin(entries_);
+  stats_.cells += length;
+  stats_.entries += 1;
+
+  return draw(position, centered, entries_.front().cells);
+}
+
+// the hash of the whole key
+inline uint64_t string_cache::slot(key const& k) {
+  return k.source ^ ((uint64_t)k.attrib * 0x9E3779B97F4A7C15ull);
+}
+
+// copy a laid out string into the backbuffer
+inline std::pair<int, int> string_cache::draw(vec2 const& position,
+    bool const centered, std::vector<CHAR_INFO> const& cells) {
+  auto& state = impl::state();
+
+  assert(position.x >= 0 && position.y >= 0);
+  assert(position.y < state.size.y);
+
+  auto const width = (size_t)state.size.x;
+  auto const row = &state.backbuffer[(size_t)position.y * width];
+  auto const length = cells.size();
+
+  // first character index (relative to the start of the row)
+  auto first = position.x;
+  if (centered)
+    first = length / 2 > (size_t)position.x ? 0 : position.x - (int)(length / 2);
+
+  // starts past the end of the row, nothing fits
+  if ((size_t)first >= width)
+    return { first, first - 1 };
+
+  auto const count = (std::min)(length, width - first);
+  memcpy(row + first, cells.data(), count * sizeof(CHAR_INFO));
+
+  return { first, first + (int)count - 1 };
+}
+
+} // namespace term
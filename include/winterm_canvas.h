@@ -0,0 +1,295 @@
+#pragma once
+
+#include "winterm.h"
+
+#include <cstdlib>
+
+
+namespace term {
+
+// a monochrome pixel surface drawn with sub-cell glyphs
+// braille packs 2x4 pixels into every cell, half_block packs 1x2
+// only cells whose pixels changed get their glyph re-encoded
+class canvas {
+public:
+  enum mode {
+    braille,   // 2x4 pixels per cell
+    half_block // 1x2 pixels per cell
+  };
+
+  // size is measured in cells, not pixels
+  explicit canvas(vec2 const& size, mode m = braille);
+
+  // the size of the canvas in pixels
+  vec2 size() const;
+
+  // turn a single pixel on or off (out of bounds pixels are ignored)
+  void set(int x, int y, bool on = true);
+
+  // is this pixel on?
+  bool get(int x, int y) const;
+
+  // turn every pixel off
+  void clear();
+
+  // draw a line between two pixels
+  void line(vec2 from, vec2 const& to);
+
+  // replace the whole canvas with a bitmap
+  // one byte per pixel, anything non-zero is on
+  void blit(uint8_t const* pixels, size_t stride);
+
+  // draw the canvas to the backbuffer (position is measured in cells)
+  void draw(vec2 const& position, attribute attrib);
+
+private:
+  // the bit of a cell that holds a pixel
+  uint8_t bit(int x, int y) const;
+
+  // update a cell's pixels, marking it dirty if they changed
+  void store(size_t cell, uint8_t bits);
+
+  // pack a row of cells from a bitmap
+  void pack_row(int row, uint8_t const* pixels, size_t stride);
+
+private:
+  mode mode_;
+
+  // the size in cells, and the number of pixels in every cell
+  vec2 cells_size_, cell_pixels_;
+
+  // the pixels of every cell packed into a byte
+  std::vector<uint8_t> bits_;
+
+  // the glyph currently used for every cell
+  std::vector<wchar_t> glyphs_;
+
+  // cells that need their glyph re-encoded
+  std::vector<uint32_t> dirty_;
+  std::vector<uint8_t> is_dirty_;
+};
+
+
+//
+//
+// implmentation below
+//
+//
+
+
+inline canvas::canvas(vec2 const& size, mode const m)
+  : mode_(m), cells_size_(size),
+    cell_pixels_(m == braille ? vec2{ 2, 4 } : vec2{ 1, 2 }),
+    bits_((size_t)size.x * size.y, 0),
+    glyphs_((size_t)size.x * size.y, L' '),
+    is_dirty_((size_t)size.x * size.y, 0) {}
+
+// the size of the canvas in pixels
+inline vec2 canvas::size() const {
+  return { cells_size_.x * cell_pixels_.x, cells_size_.y * cell_pixels_.y };
+}
+
+// turn a single pixel on or off
+inline void canvas::set(int const x, int const y, bool const on) {
+  if (x < 0 || y < 0 || x >= size().x || y >= size().y)
+    return;
+
+  auto const cell = (size_t)(y / cell_pixels_.y) *
+    cells_size_.x + x / cell_pixels_.x;
+
+  auto const b = bit(x % cell_pixels_.x, y % cell_pixels_.y);
+  store(cell, on ? (bits_[cell] | b) : (bits_[cell] & ~b));
+}
+
+// is this pixel on?
+inline bool canvas::get(int const x, int const y) const {
+  if (x < 0 || y < 0 || x >= size().x || y >= size().y)
+    return false;
+
+  auto const cell = (size_t)(y / cell_pixels_.y) *
+    cells_size_.x + x / cell_pixels_.x;
+
+  return bits_[cell] & bit(x % cell_pixels_.x, y % cell_pixels_.y);
+}
+
+// turn every pixel off
+inline void canvas::clear() {
+  for (size_t i = 0; i < bits_.size(); ++i)
+    store(i, 0);
+}
+
+// draw a line between two pixels
+inline void canvas::line(vec2 from, vec2 const& to) {
+  auto const dx = std::abs(to.x - from.x), dy = -std::abs(to.y - from.y);
+  auto const sx = from.x < to.x ? 1 : -1, sy = from.y < to.y ? 1 : -1;
+  auto error = dx + dy;
+
+  // bresenham
+  while (true) {
+    set(from.x, from.y);
+
+    if (from.x == to.x && from.y == to.y)
+      break;
+
+    auto const e2 = error * 2;
+
+    if (e2 >= dy) {
+      error += dy;
+      from.x += sx;
+    }
+
+    if (e2 <= dx) {
+      error += dx;
+      from.y += sy;
+    }
+  }
+}
+
+// replace the whole canvas with a bitmap
+inline void canvas::blit(uint8_t const* const pixels, size_t const stride) {
+  for (int row = 0; row < cells_size_.y; ++row)
+    pack_row(row, pixels + (size_t)row * cell_pixels_.y * stride, stride);
+}
+
+// draw the canvas to the backbuffer
+inline void canvas::draw(vec2 const& position, attribute const attrib) {
+  static constexpr wchar_t half_blocks[] = {
+    L' ', L'\u2580', L'\u2584', L'\u2588'
+  };
+
+  // re-encode the cells that changed
+  for (auto const cell : dirty_) {
+    auto const bits = bits_[cell];
+
+    if (bits == 0)
+      glyphs_[cell] = L' ';
+    else if (mode_ == braille)
+      glyphs_[cell] = (wchar_t)(0x2800 + bits);
+    else
+      glyphs_[cell] = half_blocks[bits];
+
+    is_dirty_[cell] = 0;
+  }
+
+  dirty_.clear();
+
+  // clip to the console
+  auto const console = term::size();
+  auto const first = vec2{ (std::max)(0, -position.x), (std::max)(0, -position.y) };
+  auto const last = vec2{
+    (std::min)(cells_size_.x, console.x - position.x),
+    (std::min)(cells_size_.y, console.y - position.y)
+  };
+
+  if (first.x >= last.x)
+    return;
+
+  for (int y = first.y; y < last.y; ++y) {
+    auto const dst = &impl::state().backbuffer[
+      (size_t)(position.y + y) * console.x + position.x + first.x];
+
+    impl::copy_run(dst, &glyphs_[(size_t)y * cells_size_.x + first.x],
+      (size_t)(last.x - first.x), attrib.value);
+  }
+}
+
+// the bit of a cell that holds a pixel
+inline uint8_t canvas::bit(int const x, int const y) const {
+  // braille dots are numbered down the left column first, then the right,
+  // with the bottom row added later on (dots 7 and 8)
+  static constexpr uint8_t braille_bits[4][2] = {
+    { 0x01, 0x08 },
+    { 0x02, 0x10 },
+    { 0x04, 0x20 },
+    { 0x40, 0x80 }
+  };
+
+  return mode_ == braille ? braille_bits[y][x] : (uint8_t)(1 << y);
+}
+
+// update a cell's pixels, marking it dirty if they changed
+inline void canvas::store(size_t const cell, uint8_t const bits) {
+  if (bits_[cell] == bits)
+    return;
+
+  bits_[cell] = bits;
+
+  if (!is_dirty_[cell]) {
+    is_dirty_[cell] = 1;
+    dirty_.push_back((uint32_t)cell);
+  }
+}
+
+// pack a row of cells from a bitmap
+inline void canvas::pack_row(int const row,
+    uint8_t const* const pixels, size_t const stride) {
+  int x = 0;
+
+#ifdef WINTERM_SSE2
+  auto const cells = &bits_[(size_t)row * cells_size_.x];
+  auto const zero = _mm_setzero_si128();
+
+  // 16 pixels per row at a time, 8 cells for braille or 16 for half blocks
+  auto const cells_per_chunk = 16 / cell_pixels_.x;
+
+  for (; x + cells_per_chunk <= cells_size_.x; x += cells_per_chunk) {
+    auto packed = zero;
+
+    for (int y = 0; y < cell_pixels_.y; ++y) {
+      auto const chunk = _mm_loadu_si128((__m128i const*)(
+        pixels + (size_t)y * stride + (size_t)x * cell_pixels_.x));
+
+      // 0xFF for every pixel that's on
+      auto const on = _mm_andnot_si128(_mm_cmpeq_epi8(chunk, zero), _mm_set1_epi8(-1));
+
+      // the bit each pixel maps to
+      auto const weights = mode_ == braille ?
+        _mm_set1_epi16((short)(bit(0, y) | (bit(1, y) << 8))) :
+        _mm_set1_epi8((char)bit(0, y));
+
+      packed = _mm_or_si128(packed, _mm_and_si128(on, weights));
+    }
+
+    // braille cells are spread over two bytes, merge them into one
+    if (mode_ == braille) {
+      packed = _mm_or_si128(_mm_and_si128(packed, _mm_set1_epi16(0x00FF)),
+        _mm_srli_epi16(packed, 8));
+      packed = _mm_packus_epi16(packed, zero);
+    }
+
+    // only touch the cells that changed
+    auto const previous = mode_ == braille ?
+      _mm_loadl_epi64((__m128i const*)(cells + x)) :
+      _mm_loadu_si128((__m128i const*)(cells + x));
+
+    auto changed = ~(unsigned)_mm_movemask_epi8(
+      _mm_cmpeq_epi8(packed, previous)) & ((1u << cells_per_chunk) - 1);
+
+    if (!changed)
+      continue;
+
+    alignas(16) uint8_t values[16];
+    _mm_store_si128((__m128i*)values, packed);
+
+    for (; changed; changed &= changed - 1) {
+      auto const i = impl::lowest_bit(changed);
+      store((size_t)row * cells_size_.x + x + i, values[i]);
+    }
+  }
+#endif
+
+  for (; x < cells_size_.x; ++x) {
+    uint8_t bits = 0;
+
+    for (int y = 0; y < cell_pixels_.y; ++y) {
+      for (int px = 0; px < cell_pixels_.x; ++px) {
+        if (pixels[(size_t)y * stride + (size_t)x * cell_pixels_.x + px])
+          bits |= bit(px, y);
+      }
+    }
+
+    store((size_t)row * cells_size_.x + x, bits);
+  }
+}
+
+} // namespace term
@@ -0,0 +1,364 @@
+#pragma once
+
+#include "winterm.h"
+
+#include <array>
+#include <chrono>
+
+
+namespace term {
+
+enum dithering {
+  dither_none,      // nearest color
+  dither_ordered,   // 4x4 bayer matrix, every pixel is independent
+  dither_diffusion  // floyd-steinberg, smoother but strictly sequential
+};
+
+// draw an rgb image (3 bytes per pixel) scaled into a rectangle of cells
+// every cell holds two pixels stacked on top of each other (using a half
+// block) which are quantized to the console's 16 color palette
+// rows can be split between multiple threads, unless dither_diffusion is used
+void image(vec2 const& position, vec2 const& size, uint8_t const* rgb,
+  vec2 const& image_size, size_t stride, dithering mode = dither_ordered,
+  unsigned threads = 1);
+
+
+//
+//
+// implmentation below
+//
+//
+
+
+namespace impl {
+
+struct rgb_color {
+  uint8_t r, g, b;
+};
+
+using palette = std::array<rgb_color, 16>;
+
+// the colors the console actually uses for each attribute
+inline palette console_palette() {
+  // the classic console colors, in case the console won't tell us
+  palette colors = { {
+    {   0,   0,   0 }, {   0,   0, 128 }, {   0, 128,   0 }, {   0, 128, 128 },
+    { 128,   0,   0 }, { 128,   0, 128 }, { 128, 128,   0 }, { 192, 192, 192 },
+    { 128, 128, 128 }, {   0,   0, 255 }, {   0, 255,   0 }, {   0, 255, 255 },
+    { 255,   0,   0 }, { 255,   0, 255 }, { 255, 255,   0 }, { 255, 255, 255 }
+  } };
+
+  CONSOLE_SCREEN_BUFFER_INFOEX info = {};
+  info.cbSize = sizeof(info);
+
+  if (GetConsoleScreenBufferInfoEx(state().out_handle, &info)) {
+    for (size_t i = 0; i < colors.size(); ++i) {
+      colors[i] = { GetRValue(info.ColorTable[i]),
+        GetGValue(info.ColorTable[i]), GetBValue(info.ColorTable[i]) };
+    }
+  }
+
+  return colors;
+}
+
+// the palette only changes when someone edits the console's properties, so
+// it's only asked for again after this long
+constexpr auto palette_refresh = std::chrono::seconds(1);
+
+// the console's palette, cached for every thread (contexts on different
+// threads can have different palettes)
+inline palette const& cached_palette() {
+  thread_local palette colors;
+  thread_local HANDLE handle = nullptr;
+  thread_local std::chrono::steady_clock::time_point queried;
+
+  auto const now = std::chrono::steady_clock::now();
+
+  if (handle != state().out_handle || now - queried >= palette_refresh) {
+    colors = console_palette();
+    handle = state().out_handle;
+    queried = now;
+  }
+
+  return colors;
+}
+
+// the threads images are drawn with, kept around between calls
+// every thread has its own, since a pool only runs one job at a time
+inline worker_pool& image_pool(unsigned const threads) {
+  thread_local std::unique_ptr<worker_pool> pool;
+
+  if (!pool || pool->size() != threads)
+    pool = std::make_unique<worker_pool>(threads);
+
+  return *pool;
+}
+
+// maps every 15-bit color to the closest palette entry
+struct palette_lut {
+  palette colors;
+  std::vector<uint8_t> nearest;
+};
+
+// the lookup table for a palette (rebuilt only when the palette changes)
+// every thread has its own, since contexts on different threads can have
+// different palettes
+inline palette_lut const& lookup_table(palette const& colors) {
+  thread_local palette_lut lut;
+
+  if (!lut.nearest.empty() &&
+      memcmp(lut.colors.data(), colors.data(), sizeof(colors)) == 0)
+    return lut;
+
+  lut.colors = colors;
+  lut.nearest.resize(1 << 15);
+
+  for (int i = 0; i < (1 << 15); ++i) {
+    // the center of this 5-bit cube
+    auto const r = ((i >> 10) & 31) * 8 + 4,
+      g = ((i >> 5) & 31) * 8 + 4, b = (i & 31) * 8 + 4;
+
+    int best = 0, best_distance = INT32_MAX;
+
+    for (int c = 0; c < 16; ++c) {
+      auto const dr = r - colors[c].r, dg = g - colors[c].g, db = b - colors[c].b;
+
+      // green is weighted higher since that's what eyes notice the most
+      auto const distance = 2 * dr * dr + 4 * dg * dg + 3 * db * db;
+
+      if (distance < best_distance) {
+        best = c;
+        best_distance = distance;
+      }
+    }
+
+    lut.nearest[i] = (uint8_t)best;
+  }
+
+  return lut;
+}
+
+// the 15-bit lookup table index of a color
+inline int lut_index(int const r, int const g, int const b) {
+  return ((r >> 3) << 10) | ((g >> 3) << 5) | (b >> 3);
+}
+
+// box filter the pixels that cover [first, last) rows of the target into
+// separate r, g and b planes
+inline void resample(uint8_t const* const rgb, vec2 const& image_size,
+    size_t const stride, vec2 const& target, int const first, int const last,
+    uint8_t* const r, uint8_t* const g, uint8_t* const b) {
+  for (int y = first; y < last; ++y) {
+    auto const y0 = y * image_size.y / target.y;
+    auto const y1 = (std::max)(y0 + 1, (y + 1) * image_size.y / target.y);
+
+    for (int x = 0; x < target.x; ++x) {
+      auto const x0 = x * image_size.x / target.x;
+      auto const x1 = (std::max)(x0 + 1, (x + 1) * image_size.x / target.x);
+
+      uint32_t sum[3] = { 0, 0, 0 };
+
+      for (int sy = y0; sy < y1; ++sy) {
+        auto const row = rgb + (size_t)sy * stride;
+
+        for (int sx = x0; sx < x1; ++sx) {
+          sum[0] += row[sx * 3 + 0];
+          sum[1] += row[sx * 3 + 1];
+          sum[2] += row[sx * 3 + 2];
+        }
+      }
+
+      auto const count = (uint32_t)((y1 - y0) * (x1 - x0));
+      auto const i = (size_t)(y - first) * target.x + x;
+
+      r[i] = (uint8_t)(sum[0] / count);
+      g[i] = (uint8_t)(sum[1] / count);
+      b[i] = (uint8_t)(sum[2] / count);
+    }
+  }
+}
+
+// quantize planes to palette indices, adding a bayer threshold to every pixel
+// first is the row the planes start at, so the pattern lines up between
+// threads
+inline void quantize_ordered(uint8_t const* const r, uint8_t const* const g,
+    uint8_t const* const b, int const width, int const first, int const rows,
+    bool const dither, palette_lut const& lut, uint8_t* const indices) {
+  static constexpr int bayer[4][4] = {
+    {  0,  8,  2, 10 },
+    { 12,  4, 14,  6 },
+    {  3, 11,  1,  9 },
+    { 15,  7, 13,  5 }
+  };
+
+  // spread the thresholds over roughly the distance between palette levels
+  auto const threshold = [&](int const x, int const y) {
+    return dither ? (bayer[y & 3][x & 3] * 2 - 15) * 4 : 0;
+  };
+
+  for (int y = 0; y < rows; ++y) {
+    auto const row = (size_t)y * width;
+    int x = 0;
+
+#ifdef WINTERM_SSE2
+    auto const zero = _mm_setzero_si128();
+    auto const max = _mm_set1_epi16(255);
+
+    // lanes line up with x & 3 since we always start at a multiple of 8
+    auto const bias = _mm_setr_epi16(
+      (short)threshold(0, first + y), (short)threshold(1, first + y),
+      (short)threshold(2, first + y), (short)threshold(3, first + y),
+      (short)threshold(0, first + y), (short)threshold(1, first + y),
+      (short)threshold(2, first + y), (short)threshold(3, first + y));
+
+    auto const channel = [&](uint8_t const* const plane) {
+      auto const c = _mm_unpacklo_epi8(
+        _mm_loadl_epi64((__m128i const*)(plane + row + x)), zero);
+
+      // clamp to [0, 255] and drop to 5 bits
+      return _mm_srli_epi16(_mm_min_epi16(_mm_max_epi16(
+        _mm_add_epi16(c, bias), zero), max), 3);
+    };
+
+    // 8 pixels at a time
+    for (; x + 8 <= width; x += 8) {
+      auto const index = _mm_or_si128(_mm_or_si128(
+        _mm_slli_epi16(channel(r), 10), _mm_slli_epi16(channel(g), 5)), channel(b));
+
+      alignas(16) uint16_t lanes[8];
+      _mm_store_si128((__m128i*)lanes, index);
+
+      for (int i = 0; i < 8; ++i)
+        indices[row + x + i] = lut.nearest[lanes[i]];
+    }
+#endif
+
+    for (; x < width; ++x) {
+      auto const t = threshold(x, first + y);
+      auto const clamp = [](int const c) { return c < 0 ? 0 : (c > 255 ? 255 : c); };
+
+      indices[row + x] = lut.nearest[lut_index(clamp(r[row + x] + t),
+        clamp(g[row + x] + t), clamp(b[row + x] + t))];
+    }
+  }
+}
+
+// quantize planes to palette indices, spreading the error of every pixel
+// onto its neighbours (floyd-steinberg)
+inline void quantize_diffusion(uint8_t const* const r, uint8_t const* const g,
+    uint8_t const* const b, int const width, int const rows,
+    palette_lut const& lut, uint8_t* const indices) {
+  // the error carried into the current and next row, with a pixel of
+  // padding on either side
+  std::vector<int> errors(6 * ((size_t)width + 2), 0);
+  auto current = errors.data(), next = current + 3 * ((size_t)width + 2);
+
+  for (int y = 0; y < rows; ++y) {
+    for (int x = 0; x < width; ++x) {
+      auto const i = (size_t)y * width + x;
+      auto const e = current + (x + 1) * 3;
+
+      auto const clamp = [](int const c) { return c < 0 ? 0 : (c > 255 ? 255 : c); };
+      int const color[3] = { clamp(r[i] + e[0] / 16),
+        clamp(g[i] + e[1] / 16), clamp(b[i] + e[2] / 16) };
+
+      auto const index = lut.nearest[lut_index(color[0], color[1], color[2])];
+      indices[i] = index;
+
+      auto const& chosen = lut.colors[index];
+      int const error[3] = { color[0] - chosen.r,
+        color[1] - chosen.g, color[2] - chosen.b };
+
+      for (int c = 0; c < 3; ++c) {
+        e[3 + c] += error[c] * 7;
+        next[x * 3 + c] += error[c] * 3;
+        next[(x + 1) * 3 + c] += error[c] * 5;
+        next[(x + 2) * 3 + c] += error[c] * 1;
+      }
+    }
+
+    std::swap(current, next);
+    std::fill(next, next + 3 * ((size_t)width + 2), 0);
+  }
+}
+
+// draw the cell rows [first, last) of an image into the backbuffer of a
+// context (the worker threads don't have the caller's context current)
+inline void image_rows(context_state& ctx, vec2 const& position, vec2 const& size,
+    uint8_t const* const rgb, vec2 const& image_size, size_t const stride,
+    dithering const mode, palette_lut const& lut, int const first, int const last) {
+  auto const target = vec2{ size.x, size.y * 2 };
+  auto const pixels = (size_t)target.x * (last - first) * 2;
+
+  std::vector<uint8_t> planes(pixels * 3), indices(pixels);
+  auto const r = planes.data(), g = r + pixels, b = g + pixels;
+
+  resample(rgb, image_size, stride, target, first * 2, last * 2, r, g, b);
+
+  if (mode == dither_diffusion)
+    quantize_diffusion(r, g, b, target.x, (last - first) * 2, lut, indices.data());
+  else {
+    quantize_ordered(r, g, b, target.x, first * 2, (last - first) * 2,
+      mode == dither_ordered, lut, indices.data());
+  }
+
+  auto const console = ctx.size;
+
+  for (int y = first; y < last; ++y) {
+    auto const cy = position.y + y;
+    if (cy < 0 || cy >= console.y)
+      continue;
+
+    auto const top = &indices[(size_t)(y - first) * 2 * target.x];
+    auto const bottom = top + target.x;
+
+    for (int x = 0; x < size.x; ++x) {
+      auto const cx = position.x + x;
+      if (cx < 0 || cx >= console.x)
+        continue;
+
+      // the top pixel is the foreground of an upper half block
+      ctx.backbuffer[(size_t)cy * console.x + cx] = {
+        L'\u2580', (WORD)(top[x] | (bottom[x] << 4))
+      };
+    }
+  }
+}
+
+} // namespace impl
+
+// draw an rgb image scaled into a rectangle of cells
+inline void image(vec2 const& position, vec2 const& size, uint8_t const* const rgb,
+    vec2 const& image_size, size_t const stride, dithering const mode,
+    unsigned const threads) {
+  if (size.x <= 0 || size.y <= 0 || image_size.x <= 0 || image_size.y <= 0)
+    return;
+
+  auto const& lut = impl::lookup_table(impl::cached_palette());
+  auto& ctx = impl::state();
+
+  // error diffusion depends on every pixel before it
+  auto const workers = mode == dither_diffusion ? 1 :
+    (std::min)((int)(std::max)(threads, 1u), size.y);
+
+  if (workers == 1) {
+    impl::image_rows(ctx, position, size, rgb, image_size, stride, mode, lut, 0, size.y);
+    return;
+  }
+
+  // the pool is sized by threads so small images don't recreate it, the
+  // bands past workers have nothing to do
+  auto job = [&](unsigned const band) {
+    if ((int)band >= workers)
+      return;
+
+    auto const first = size.y * (int)band / workers,
+      last = size.y * ((int)band + 1) / workers;
+
+    impl::image_rows(ctx, position, size, rgb, image_size, stride, mode, lut, first, last);
+  };
+
+  impl::image_pool(threads).run(job);
+}
+
+} // namespace term
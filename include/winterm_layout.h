@@ -0,0 +1,233 @@
+#pragma once
+
+#include "winterm.h"
+
+
+namespace term {
+
+// a block of text that gets word wrapped to fit a width
+// color codes carry over from one line to the next, and the line breaks are
+// only recomputed when the text is edited or the paragraph is drawn at a
+// different width
+class paragraph {
+public:
+  paragraph() = default;
+  explicit paragraph(std::wstring_view text);
+
+  // replace the text
+  void text(std::wstring_view text);
+
+  // replace the text with utf-8 text
+  void text(std::string_view text);
+
+  // add text to the end
+  void append(std::wstring_view text);
+
+  // the text, including color codes
+  std::wstring const& text() const;
+
+  // the number of lines the text takes up at a width
+  size_t lines(int width);
+
+  // draw the text into an area, starting at a specific line (for scrolling)
+  // the cells after the end of a line are left untouched
+  // returns the number of lines drawn
+  int draw(rect const& area, attribute attrib, size_t first_line = 0);
+
+  // how many times the line breaks had to be computed
+  size_t layouts() const;
+
+private:
+  // a single line of wrapped text
+  struct line {
+    // the range of the text it covers, [begin, end)
+    uint32_t begin, end;
+
+    // the colors that are in effect at the start of the line, -1 if it
+    // uses the color that the paragraph is drawn with
+    int8_t foreground, background;
+  };
+
+  // compute the line breaks for a width (if they aren't already)
+  void layout(int width);
+
+private:
+  std::wstring text_;
+
+  // the width that lines_ was computed for, -1 if the text changed since
+  int width_ = -1;
+  std::vector<line> lines_;
+
+  size_t layouts_ = 0;
+};
+
+
+//
+//
+// implmentation below
+//
+//
+
+
+inline paragraph::paragraph(std::wstring_view const text)
+  : text_(text) {}
+
+// replace the text
+inline void paragraph::text(std::wstring_view const text) {
+  text_.assign(text.data(), text.size());
+  width_ = -1;
+}
+
+// replace the text with utf-8 text
+inline void paragraph::text(std::string_view const text) {
+  text_.clear();
+
+  for (auto it = text.data(), end = it + text.size(); it != end;)
+    text_.push_back(impl::decode(it, end));
+
+  width_ = -1;
+}
+
+// add text to the end
+inline void paragraph::append(std::wstring_view const text) {
+  text_.append(text.data(), text.size());
+  width_ = -1;
+}
+
+// the text, including color codes
+inline std::wstring const& paragraph::text() const {
+  return text_;
+}
+
+// the number of lines the text takes up at a width
+inline size_t paragraph::lines(int const width) {
+  layout(width);
+  return lines_.size();
+}
+
+// draw the text into an area, starting at a specific line
+inline int paragraph::draw(rect const& area, attribute const attrib,
+    size_t const first_line) {
+  assert(area.x >= 0 && area.y >= 0);
+
+  if (area.width <= 0)
+    return 0;
+
+  layout(area.width);
+
+  auto const console = impl::state().size;
+  auto const width = (size_t)(std::min)(area.width, console.x - area.x);
+
+  int drawn = 0;
+
+  for (auto i = first_line; i < lines_.size() && drawn < area.height; ++i, ++drawn) {
+    auto const y = area.y + drawn;
+    if (y >= console.y || area.x >= console.x)
+      break;
+
+    auto const& l = lines_[i];
+
+    // pick up the colors where the previous line left off
+    auto a = attrib;
+    if (l.foreground >= 0)
+      a.foreground((uint16_t)l.foreground);
+    if (l.background >= 0)
+      a.background((uint16_t)l.background);
+
+    impl::layout(std::wstring_view(text_).substr(l.begin, l.end - l.begin), a,
+      &impl::state().backbuffer[(size_t)y * console.x + area.x], width, false);
+  }
+
+  return drawn;
+}
+
+// how many times the line breaks had to be computed
+inline size_t paragraph::layouts() const {
+  return layouts_;
+}
+
+// compute the line breaks for a width
+inline void paragraph::layout(int const width) {
+  if (width == width_)
+    return;
+
+  width_ = width;
+  layouts_ += 1;
+  lines_.clear();
+
+  auto const size = text_.size();
+
+  // the colors at the current position
+  int8_t foreground = -1, background = -1;
+
+  for (size_t begin = 0;;) {
+    line l = { (uint32_t)begin, (uint32_t)size, foreground, background };
+
+    // the last space on this line, and the colors at that point
+    auto space = SIZE_MAX;
+    int8_t space_foreground = -1, space_background = -1;
+
+    // where the next line starts
+    auto next = SIZE_MAX;
+
+    for (size_t i = begin, column = 0; i < size;) {
+      auto const c = text_[i];
+      size_t length = 1;
+
+      if (c == L'\n') {
+        l.end = (uint32_t)i;
+        next = i + 1;
+        break;
+      }
+      // escaped #, same rules as impl::layout()
+      else if (c == L'\\' && i + 1 < size && text_[i + 1] == L'#')
+        length = 2;
+      // color codes don't take up any space
+      else if (c == L'#' && i + 2 < size) {
+        if (text_[i + 1] != L'X')
+          foreground = (int8_t)(text_[i + 1] - L'0');
+        if (text_[i + 2] != L'X')
+          background = (int8_t)(text_[i + 2] - L'0');
+
+        i += 3;
+        continue;
+      }
+
+      // this character doesn't fit anymore (every line fits at least one)
+      if (column > 0 && column + 1 > (size_t)width) {
+        // break after the last space, or in the middle of the word if it's
+        // longer than the whole line
+        if (space != SIZE_MAX) {
+          l.end = (uint32_t)space;
+          next = space + 1;
+          foreground = space_foreground;
+          background = space_background;
+        }
+        else {
+          l.end = (uint32_t)i;
+          next = i;
+        }
+
+        break;
+      }
+
+      if (c == L' ') {
+        space = i;
+        space_foreground = foreground;
+        space_background = background;
+      }
+
+      column += 1;
+      i += length;
+    }
+
+    lines_.push_back(l);
+
+    if (next == SIZE_MAX)
+      break;
+
+    begin = next;
+  }
+}
+
+} // namespace term
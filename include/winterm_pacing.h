@@ -0,0 +1,151 @@
+#pragma once
+
+#include "winterm.h"
+
+#include <thread>
+
+
+namespace term {
+
+// what the frame pacer has been doing
+struct pacing_stats {
+  // frames that were written, and frames that were skipped because nothing
+  // changed since the last one that was
+  size_t presented = 0,
+    idle = 0;
+
+  // how many times the frame rate was lowered because writing took too
+  // long, and raised again once it recovered
+  size_t downshifts = 0,
+    upshifts = 0;
+
+  // the average time it takes to write a frame (exponential moving average)
+  double write_seconds = 0.0;
+};
+
+// limits how often frames are written to the console
+// present() waits for the next frame to be due and only writes it if
+// something changed, if writing frames takes longer than the frame budget
+// (a slow terminal or a saturated ssh link) the frame rate is lowered until
+// it fits, and raised back up once it does
+class frame_pacer {
+public:
+  explicit frame_pacer(double fps = 60.0, double min_fps = 5.0);
+
+  // wait until the next frame is due, then write it (or skip it if
+  // flushing wouldn't write anything, see needs_flush())
+  // returns true if the frame was written
+  bool present();
+
+  // change the frame rate that is aimed for
+  void target(double fps);
+
+  // the frame rate that is currently being used, can be lower than the
+  // target if the console can't keep up
+  double fps() const;
+
+  pacing_stats const& stats() const;
+
+private:
+  using clock = std::chrono::steady_clock;
+
+  // lower or raise the frame rate based on how long writing took
+  void adapt();
+
+private:
+  double target_, min_, fps_;
+  clock::time_point next_;
+
+  // frames in a row that were written well within the budget
+  int fast_frames_ = 0;
+
+  pacing_stats stats_;
+};
+
+
+//
+//
+// implmentation below
+//
+//
+
+
+inline frame_pacer::frame_pacer(double const fps, double const min_fps)
+  : target_(fps), min_((std::min)(min_fps, fps)), fps_(fps), next_(clock::now()) {}
+
+// wait until the next frame is due, then write it
+inline bool frame_pacer::present() {
+  auto const period = std::chrono::duration_cast<clock::duration>(
+    std::chrono::duration<double>(1.0 / fps_));
+
+  std::this_thread::sleep_until(next_);
+
+  // don't try to catch up on frames that were missed, that would just
+  // write a burst of them
+  auto const now = clock::now();
+  next_ = now - next_ > period ? now + period : next_ + period;
+
+  // bandwidth_aware output can still have cells to write even if the
+  // backbuffer stayed the same
+  if (!needs_flush()) {
+    stats_.idle += 1;
+    skip_frame();
+    return false;
+  }
+
+  auto const start = clock::now();
+  flush();
+
+  auto const seconds = std::chrono::duration<double>(clock::now() - start).count();
+  stats_.write_seconds = stats_.presented == 0 ? seconds :
+    stats_.write_seconds * 0.9 + seconds * 0.1;
+
+  stats_.presented += 1;
+  adapt();
+
+  return true;
+}
+
+// change the frame rate that is aimed for
+inline void frame_pacer::target(double const fps) {
+  target_ = fps;
+  min_ = (std::min)(min_, fps);
+  fps_ = fps;
+  fast_frames_ = 0;
+}
+
+// the frame rate that is currently being used
+inline double frame_pacer::fps() const {
+  return fps_;
+}
+
+inline pacing_stats const& frame_pacer::stats() const {
+  return stats_;
+}
+
+// lower or raise the frame rate based on how long writing took
+inline void frame_pacer::adapt() {
+  auto const budget = 1.0 / fps_;
+
+  // writing eats most of the frame, back off before frames pile up
+  if (stats_.write_seconds > budget * 0.8 && fps_ > min_) {
+    fps_ = (std::max)(min_, fps_ * 0.75);
+    fast_frames_ = 0;
+    stats_.downshifts += 1;
+    return;
+  }
+
+  // only speed up again after writing was comfortably fast for a while, so
+  // it doesn't bounce back and forth
+  if (stats_.write_seconds < budget * 0.4 && fps_ < target_) {
+    if (++fast_frames_ >= 30) {
+      fps_ = (std::min)(target_, fps_ * 1.25);
+      fast_frames_ = 0;
+      stats_.upshifts += 1;
+    }
+  }
+  else
+    fast_frames_ = 0;
+}
+
+} // namespace term
@@ -0,0 +1,559 @@
+#pragma once
+
+#include "winterm.h"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+
+
+namespace term {
+namespace impl {
+
+struct frame_header;
+
+// where every frame of a recording starts, built by walking the headers
+// shared by term::recording and term::player
+struct frame_index {
+  // byte offset and timestamp of every frame
+  std::vector<uint64_t> offsets, timestamps;
+
+  // indices of every keyframe, in order
+  std::vector<size_t> keyframes;
+
+  // add the frame that starts at offset
+  void add(uint64_t offset, frame_header const& header);
+
+  // a recording can only be decoded if it starts with a keyframe
+  bool valid() const;
+
+  // the first frame that has to be decoded to get to frame, which is the
+  // closest keyframe before it, or the frame after current if that's on the way
+  size_t decode_from(size_t frame, size_t current) const;
+};
+
+// the frame that was decoded last, frames are applied on top of it
+struct frame_decoder {
+  size_t frame = SIZE_MAX;
+  vec2 size = { 0, 0 };
+  std::vector<CHAR_INFO> cells;
+
+  // apply an encoded frame on top of the current one
+  // returns false if the data is corrupt
+  bool apply(size_t index, frame_header const& header,
+    uint8_t const* payload);
+
+  // decode every frame up to frame, read(i, header, payload) fetches
+  // frame i and returns false if it couldn't be read
+  template <typename Read>
+  bool seek(frame_index const& index, size_t frame, Read&& read);
+};
+
+} // namespace impl
+
+// how much recording has cost so far
+struct record_stats {
+  size_t frames = 0,
+    keyframes = 0;
+
+  // bytes written to the file, including headers
+  size_t bytes = 0;
+
+  // time spent encoding and writing frames
+  double seconds = 0.0;
+};
+
+// records every flushed frame to a file (of the context that is current
+// when it's created, which has to outlive it)
+// only cells that changed since the previous frame are written (run-length
+// encoded), with a full keyframe every keyframe_interval frames
+class recorder {
+public:
+  explicit recorder(std::filesystem::path const& path,
+    size_t keyframe_interval = 300);
+  ~recorder();
+
+  recorder(recorder const&) = delete;
+  recorder& operator=(recorder const&) = delete;
+
+  // was the file successfully opened?
+  bool is_open() const;
+
+  // how much recording has cost so far
+  record_stats const& stats() const;
+
+private:
+  // encode and write a single frame
+  void record(CHAR_INFO const* cells, vec2 const& size);
+
+private:
+  std::ofstream file_;
+
+  // the hook is removed from the context it was added to, whichever one is
+  // current when this is destroyed
+  impl::context_state* context_ = nullptr;
+  int hook_ = -1;
+
+  size_t keyframe_interval_ = 0,
+    frames_since_keyframe_ = 0;
+
+  // the previously recorded frame
+  std::vector<CHAR_INFO> previous_;
+  vec2 previous_size_ = { 0, 0 };
+
+  // the encoded frame before it gets written to the file
+  std::vector<uint8_t> buffer_;
+
+  std::chrono::steady_clock::time_point start_;
+  record_stats stats_;
+};
+
+// reads a recording made by term::recorder
+class recording {
+public:
+  explicit recording(std::filesystem::path const& path);
+
+  // was the file successfully opened (and is it a recording)?
+  bool is_open() const;
+
+  // the number of frames in the recording
+  size_t frames() const;
+
+  // decode a specific frame, starting from the closest keyframe
+  // returns false if the frame is out of range or corrupt
+  bool seek(size_t frame);
+
+  // decode the frame after the current one
+  bool next();
+
+  // the index of the current frame
+  size_t frame() const;
+
+  // the time of the current frame (microseconds since recording started)
+  uint64_t timestamp() const;
+
+  // the size of the current frame
+  vec2 size() const;
+
+  // the cells of the current frame
+  CHAR_INFO const* cells() const;
+
+private:
+  // read the header and payload of a frame
+  bool read(size_t frame, impl::frame_header& header, uint8_t const*& payload);
+
+private:
+  std::ifstream file_;
+  bool open_ = false;
+
+  impl::frame_index index_;
+  impl::frame_decoder decoder_;
+  std::vector<uint8_t> payload_;
+};
+
+
+//
+//
+// implmentation below
+//
+//
+
+
+namespace impl {
+
+// every recording starts with this, followed by a 16-bit version
+constexpr char record_magic[4] = { 'W', 'T', 'R', 'M' };
+constexpr uint16_t record_version = 1;
+constexpr size_t record_file_header_size = 8;
+
+// every frame starts with this header, followed by the encoded cells
+struct frame_header {
+  bool keyframe = false;
+  uint32_t payload_size = 0;
+  uint64_t timestamp = 0;
+  uint16_t width = 0, height = 0;
+};
+constexpr size_t frame_header_size = 17;
+
+// runs of at least this many identical cells are stored as a single cell
+constexpr size_t min_repeat = 3;
+
+// serialize a frame header (little-endian, same as the cells)
+inline void write_frame_header(uint8_t* const dst, frame_header const& header) {
+  dst[0] = header.keyframe ? 1 : 0;
+  memcpy(dst + 1, &header.payload_size, 4);
+  memcpy(dst + 5, &header.timestamp, 8);
+  memcpy(dst + 13, &header.width, 2);
+  memcpy(dst + 15, &header.height, 2);
+}
+
+// deserialize a frame header
+inline frame_header read_frame_header(uint8_t const* const src) {
+  frame_header header;
+  header.keyframe = src[0] != 0;
+  memcpy(&header.payload_size, src + 1, 4);
+  memcpy(&header.timestamp, src + 5, 8);
+  memcpy(&header.width, src + 13, 2);
+  memcpy(&header.height, src + 15, 2);
+  return header;
+}
+
+// append a variable-length integer (7 bits per byte)
+inline void write_varint(std::vector<uint8_t>& out, size_t value) {
+  while (value >= 0x80) {
+    out.push_back((uint8_t)(value | 0x80));
+    value >>= 7;
+  }
+
+  out.push_back((uint8_t)value);
+}
+
+// read a variable-length integer, returns false if it is truncated
+inline bool read_varint(uint8_t const*& it,
+    uint8_t const* const end, size_t& value) {
+  value = 0;
+
+  for (int shift = 0; it != end && shift < 64; shift += 7) {
+    auto const byte = *it++;
+    value |= (size_t)(byte & 0x7F) << shift;
+
+    if (!(byte & 0x80))
+      return true;
+  }
+
+  return false;
+}
+
+// encode every cell that differs from previous (or every cell if previous
+// is null) as a list of (skip, run) pairs
+// a run is either a single repeated cell or a list of literal cells
+inline void encode_frame(std::vector<uint8_t>& out, CHAR_INFO const* const cells,
+    CHAR_INFO const* const previous, size_t const count) {
+  auto const changed = [&](size_t const i) {
+    return !previous || cell_bits(cells[i]) != cell_bits(previous[i]);
+  };
+
+  // the number of cells identical to cells[i], starting at i
+  auto const repeats = [&](size_t const i, size_t const limit) {
+    size_t n = 1;
+    while (n < limit && i + n < count &&
+        cell_bits(cells[i + n]) == cell_bits(cells[i]))
+      n += 1;
+    return n;
+  };
+
+  auto const append = [&](size_t const first, size_t const n) {
+    auto const offset = out.size();
+    out.resize(offset + n * sizeof(CHAR_INFO));
+    memcpy(out.data() + offset, cells + first, n * sizeof(CHAR_INFO));
+  };
+
+  // the position the decoder will be at
+  size_t position = 0;
+
+  for (size_t i = 0; i < count;) {
+    if (!changed(i)) {
+      i += 1;
+      continue;
+    }
+
+    write_varint(out, i - position);
+
+    // a run of identical cells (unchanged cells included, they're free)
+    if (auto const run = repeats(i, SIZE_MAX); run >= min_repeat) {
+      write_varint(out, (run << 1) | 1);
+      append(i, 1);
+
+      i += run;
+      position = i;
+      continue;
+    }
+
+    // literal cells until the next unchanged cell or repeated run
+    auto const first = i;
+    while (i < count && changed(i) && repeats(i, min_repeat) < min_repeat)
+      i += 1;
+
+    write_varint(out, (i - first) << 1);
+    append(first, i - first);
+
+    position = i;
+  }
+}
+
+// apply an encoded frame on top of cells
+// returns false if the data is corrupt
+inline bool decode_frame(uint8_t const* const data, size_t const size,
+    CHAR_INFO* const cells, size_t const count) {
+  auto it = data;
+  auto const end = data + size;
+
+  size_t position = 0;
+
+  while (it != end) {
+    size_t skip = 0, header = 0;
+    if (!read_varint(it, end, skip) || !read_varint(it, end, header))
+      return false;
+
+    auto const n = header >> 1;
+    if (skip > count - position || n > count - position - skip)
+      return false;
+
+    position += skip;
+
+    // a single repeated cell
+    if (header & 1) {
+      if ((size_t)(end - it) < sizeof(CHAR_INFO))
+        return false;
+
+      CHAR_INFO cell;
+      memcpy(&cell, it, sizeof(cell));
+      it += sizeof(cell);
+
+      std::fill(cells + position, cells + position + n, cell);
+    }
+    // literal cells
+    else {
+      if ((size_t)(end - it) / sizeof(CHAR_INFO) < n)
+        return false;
+
+      memcpy(cells + position, it, n * sizeof(CHAR_INFO));
+      it += n * sizeof(CHAR_INFO);
+    }
+
+    position += n;
+  }
+
+  return true;
+}
+
+// add the frame that starts at offset
+inline void frame_index::add(uint64_t const offset, frame_header const& header) {
+  if (header.keyframe)
+    keyframes.push_back(offsets.size());
+
+  offsets.push_back(offset);
+  timestamps.push_back(header.timestamp);
+}
+
+// a recording can only be decoded if it starts with a keyframe
+inline bool frame_index::valid() const {
+  return !keyframes.empty() && keyframes.front() == 0;
+}
+
+// the first frame that has to be decoded to get to frame
+inline size_t frame_index::decode_from(size_t const frame, size_t const current) const {
+  // the closest keyframe before (or at) the requested frame
+  auto const keyframe = *(std::upper_bound(
+    begin(keyframes), end(keyframes), frame) - 1);
+
+  // keep decoding from the current frame if it's on the way
+  if (current != SIZE_MAX && current >= keyframe && current <= frame)
+    return current + 1;
+
+  return keyframe;
+}
+
+// apply an encoded frame on top of the current one
+inline bool frame_decoder::apply(size_t const index,
+    frame_header const& header, uint8_t const* const payload) {
+  // keyframes start from scratch
+  if (header.keyframe) {
+    size = { header.width, header.height };
+    cells.assign((size_t)header.width * header.height, CHAR_INFO{});
+  }
+
+  if (!decode_frame(payload, header.payload_size, cells.data(), cells.size()))
+    return false;
+
+  frame = index;
+  return true;
+}
+
+// decode every frame up to frame
+template <typename Read>
+inline bool frame_decoder::seek(frame_index const& index,
+    size_t const target, Read&& read) {
+  for (auto i = index.decode_from(target, frame); i <= target; ++i) {
+    frame_header header;
+    uint8_t const* payload = nullptr;
+
+    if (!read(i, header, payload) || !apply(i, header, payload)) {
+      frame = SIZE_MAX;
+      return false;
+    }
+  }
+
+  return true;
+}
+
+} // namespace impl
+
+inline recorder::recorder(std::filesystem::path const& path,
+    size_t const keyframe_interval)
+  : file_(path, std::ios::binary | std::ios::trunc),
+    keyframe_interval_(keyframe_interval),
+    start_(std::chrono::steady_clock::now()) {
+  if (!file_)
+    return;
+
+  uint8_t header[impl::record_file_header_size] = { 0 };
+  memcpy(header, impl::record_magic, sizeof(impl::record_magic));
+  memcpy(header + 4, &impl::record_version, sizeof(impl::record_version));
+  file_.write((char const*)header, sizeof(header));
+
+  stats_.bytes += sizeof(header);
+
+  context_ = &impl::state();
+  hook_ = add_flush_hook([this](CHAR_INFO const* const cells, vec2 const& size) {
+    record(cells, size);
+  });
+}
+
+inline recorder::~recorder() {
+  if (hook_ != -1)
+    impl::remove_flush_hook(*context_, hook_);
+}
+
+// was the file successfully opened?
+inline bool recorder::is_open() const {
+  return file_.is_open() && file_.good();
+}
+
+// how much recording has cost so far
+inline record_stats const& recorder::stats() const {
+  return stats_;
+}
+
+// encode and write a single frame
+inline void recorder::record(CHAR_INFO const* const cells, vec2 const& size) {
+  auto const begin = std::chrono::steady_clock::now();
+  auto const count = (size_t)size.x * (size_t)size.y;
+
+  // the first frame and any resize need a keyframe
+  auto const keyframe = previous_.empty() ||
+    size.x != previous_size_.x || size.y != previous_size_.y ||
+    frames_since_keyframe_ >= keyframe_interval_;
+
+  // leave space for the header, we don't know the payload size yet
+  buffer_.resize(impl::frame_header_size);
+  impl::encode_frame(buffer_, cells, keyframe ? nullptr : previous_.data(), count);
+
+  impl::frame_header header;
+  header.keyframe = keyframe;
+  header.payload_size = (uint32_t)(buffer_.size() - impl::frame_header_size);
+  header.timestamp = (uint64_t)std::chrono::duration_cast<
+    std::chrono::microseconds>(begin - start_).count();
+  header.width = (uint16_t)size.x;
+  header.height = (uint16_t)size.y;
+  impl::write_frame_header(buffer_.data(), header);
+
+  file_.write((char const*)buffer_.data(), (std::streamsize)buffer_.size());
+
+  previous_.assign(cells, cells + count);
+  previous_size_ = size;
+
+  frames_since_keyframe_ = keyframe ? 1 : frames_since_keyframe_ + 1;
+
+  stats_.frames += 1;
+  stats_.keyframes += keyframe ? 1 : 0;
+  stats_.bytes += buffer_.size();
+  stats_.seconds += std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - begin).count();
+}
+
+inline recording::recording(std::filesystem::path const& path)
+  : file_(path, std::ios::binary) {
+  uint8_t header[impl::frame_header_size];
+
+  // make sure this is actually a recording
+  if (!file_.read((char*)header, impl::record_file_header_size))
+    return;
+
+  uint16_t version;
+  memcpy(&version, header + 4, sizeof(version));
+
+  if (memcmp(header, impl::record_magic, sizeof(impl::record_magic)) != 0 ||
+      version != impl::record_version)
+    return;
+
+  // index every frame by walking the headers
+  uint64_t offset = impl::record_file_header_size;
+  while (file_.read((char*)header, impl::frame_header_size)) {
+    auto const frame = impl::read_frame_header(header);
+    index_.add(offset, frame);
+
+    offset += impl::frame_header_size + frame.payload_size;
+    file_.seekg((std::streamoff)offset);
+  }
+
+  file_.clear();
+  open_ = index_.valid();
+}
+
+// was the file successfully opened (and is it a recording)?
+inline bool recording::is_open() const {
+  return open_;
+}
+
+// the number of frames in the recording
+inline size_t recording::frames() const {
+  return index_.offsets.size();
+}
+
+// decode a specific frame, starting from the closest keyframe
+inline bool recording::seek(size_t const frame) {
+  if (!open_ || frame >= frames())
+    return false;
+
+  return decoder_.seek(index_, frame, [this](size_t const i,
+      impl::frame_header& header, uint8_t const*& payload) {
+    return read(i, header, payload);
+  });
+}
+
+// decode the frame after the current one
+inline bool recording::next() {
+  return seek(decoder_.frame == SIZE_MAX ? 0 : decoder_.frame + 1);
+}
+
+// the index of the current frame
+inline size_t recording::frame() const {
+  return decoder_.frame;
+}
+
+// the time of the current frame (microseconds since recording started)
+inline uint64_t recording::timestamp() const {
+  return decoder_.frame == SIZE_MAX ? 0 : index_.timestamps[decoder_.frame];
+}
+
+// the size of the current frame
+inline vec2 recording::size() const {
+  return decoder_.size;
+}
+
+// the cells of the current frame
+inline CHAR_INFO const* recording::cells() const {
+  return decoder_.cells.data();
+}
+
+// read the header and payload of a frame
+inline bool recording::read(size_t const frame,
+    impl::frame_header& header, uint8_t const*& payload) {
+  uint8_t bytes[impl::frame_header_size];
+
+  file_.seekg((std::streamoff)index_.offsets[frame]);
+  if (!file_.read((char*)bytes, sizeof(bytes)))
+    return false;
+
+  header = impl::read_frame_header(bytes);
+
+  payload_.resize(header.payload_size);
+  if (!file_.read((char*)payload_.data(), (std::streamsize)payload_.size()))
+    return false;
+
+  payload = payload_.data();
+  return true;
+}
+
+} // namespace term
@@ -0,0 +1,238 @@
+#pragma once
+
+#include "winterm_record.h"
+
+#include <thread>
+
+
+namespace term {
+
+// plays back a recording made by term::recorder
+// the file is memory-mapped and indexed up front, so seeking to any point in
+// time only decodes from the closest keyframe
+// nothing touches the console until draw(), present() or play() is called,
+// which makes it usable headlessly to regenerate specific frames
+class player {
+public:
+  explicit player(std::filesystem::path const& path);
+  ~player();
+
+  player(player const&) = delete;
+  player& operator=(player const&) = delete;
+
+  // was the file successfully mapped (and is it a recording)?
+  bool is_open() const;
+
+  // the number of frames in the recording
+  size_t frames() const;
+
+  // the timestamp of the last frame (microseconds)
+  uint64_t duration() const;
+
+  // decode the frame that was on screen at a specific time (microseconds)
+  bool seek(uint64_t time);
+
+  // decode a specific frame
+  bool seek_frame(size_t frame);
+
+  // the index of the current frame
+  size_t frame() const;
+
+  // the time of the current frame (microseconds since recording started)
+  uint64_t timestamp() const;
+
+  // the size of the current frame
+  vec2 size() const;
+
+  // the cells of the current frame
+  CHAR_INFO const* cells() const;
+
+  // copy the current frame into the backbuffer, resizing if needed
+  void draw() const;
+
+  // draw the current frame and flush it to the console
+  void present() const;
+
+  // play from the current frame until the end of the recording
+  // speed is a multiplier, 2.0 plays twice as fast as it was recorded
+  void play(double speed = 1.0);
+
+private:
+  HANDLE file_ = INVALID_HANDLE_VALUE,
+    mapping_ = nullptr;
+
+  uint8_t const* data_ = nullptr;
+  size_t data_size_ = 0;
+
+  impl::frame_index index_;
+  impl::frame_decoder decoder_;
+};
+
+
+//
+//
+// implmentation below
+//
+//
+
+
+inline player::player(std::filesystem::path const& path) {
+  file_ = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+    nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+  if (file_ == INVALID_HANDLE_VALUE)
+    return;
+
+  LARGE_INTEGER file_size;
+  if (!GetFileSizeEx(file_, &file_size) ||
+      file_size.QuadPart < (LONGLONG)impl::record_file_header_size)
+    return;
+
+  mapping_ = CreateFileMappingW(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (!mapping_)
+    return;
+
+  data_ = (uint8_t const*)MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+  if (!data_)
+    return;
+
+  data_size_ = (size_t)file_size.QuadPart;
+
+  // make sure this is actually a recording
+  uint16_t version;
+  memcpy(&version, data_ + 4, sizeof(version));
+
+  if (memcmp(data_, impl::record_magic, sizeof(impl::record_magic)) != 0 ||
+      version != impl::record_version)
+    return;
+
+  // index every frame by walking the headers
+  auto offset = impl::record_file_header_size;
+  while (data_size_ - offset >= impl::frame_header_size) {
+    auto const header = impl::read_frame_header(data_ + offset);
+
+    // truncated frame, probably still being recorded
+    if (data_size_ - offset - impl::frame_header_size < header.payload_size)
+      break;
+
+    index_.add(offset, header);
+    offset += impl::frame_header_size + header.payload_size;
+  }
+}
+
+inline player::~player() {
+  if (data_)
+    UnmapViewOfFile(data_);
+
+  if (mapping_)
+    CloseHandle(mapping_);
+
+  if (file_ != INVALID_HANDLE_VALUE)
+    CloseHandle(file_);
+}
+
+// was the file successfully mapped (and is it a recording)?
+inline bool player::is_open() const {
+  return index_.valid();
+}
+
+// the number of frames in the recording
+inline size_t player::frames() const {
+  return index_.offsets.size();
+}
+
+// the timestamp of the last frame (microseconds)
+inline uint64_t player::duration() const {
+  return index_.timestamps.empty() ? 0 : index_.timestamps.back();
+}
+
+// decode the frame that was on screen at a specific time (microseconds)
+inline bool player::seek(uint64_t const time) {
+  // the last frame that was presented before (or at) this time
+  auto const& timestamps = index_.timestamps;
+
+  auto const it = std::upper_bound(begin(timestamps), end(timestamps), time);
+  if (it == begin(timestamps))
+    return seek_frame(0);
+
+  return seek_frame((size_t)(it - begin(timestamps)) - 1);
+}
+
+// decode a specific frame
+inline bool player::seek_frame(size_t const frame) {
+  if (!is_open() || frame >= frames())
+    return false;
+
+  // the whole file is mapped, and the index only has complete frames
+  return decoder_.seek(index_, frame, [this](size_t const i,
+      impl::frame_header& header, uint8_t const*& payload) {
+    auto const offset = (size_t)index_.offsets[i];
+
+    header = impl::read_frame_header(data_ + offset);
+    payload = data_ + offset + impl::frame_header_size;
+    return true;
+  });
+}
+
+// the index of the current frame
+inline size_t player::frame() const {
+  return decoder_.frame;
+}
+
+// the time of the current frame (microseconds since recording started)
+inline uint64_t player::timestamp() const {
+  return decoder_.frame == SIZE_MAX ? 0 : index_.timestamps[decoder_.frame];
+}
+
+// the size of the current frame
+inline vec2 player::size() const {
+  return decoder_.size;
+}
+
+// the cells of the current frame
+inline CHAR_INFO const* player::cells() const {
+  return decoder_.cells.data();
+}
+
+// copy the current frame into the backbuffer, resizing if needed
+inline void player::draw() const {
+  if (decoder_.frame == SIZE_MAX)
+    return;
+
+  auto const& size = decoder_.size;
+  if (term::size().x != size.x || term::size().y != size.y)
+    term::size(size);
+
+  memcpy(impl::state().backbuffer.get(),
+    decoder_.cells.data(), decoder_.cells.size() * sizeof(CHAR_INFO));
+}
+
+// draw the current frame and flush it to the console
+inline void player::present() const {
+  draw();
+  flush();
+}
+
+// play from the current frame until the end of the recording
+inline void player::play(double const speed) {
+  assert(speed > 0.0);
+
+  if (decoder_.frame == SIZE_MAX && !seek_frame(0))
+    return;
+
+  auto const start = std::chrono::steady_clock::now();
+  auto const first = timestamp();
+
+  while (true) {
+    // wait until this frame is due
+    std::this_thread::sleep_until(start + std::chrono::microseconds(
+      (int64_t)((double)(timestamp() - first) / speed)));
+
+    present();
+
+    if (decoder_.frame + 1 >= frames() || !seek_frame(decoder_.frame + 1))
+      break;
+  }
+}
+
+} // namespace term
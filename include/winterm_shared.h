@@ -0,0 +1,300 @@
+#pragma once
+
+#include "winterm.h"
+
+#include <atomic>
+#include <new>
+#include <thread>
+
+
+namespace term {
+
+// publishes every flushed frame into a named shared memory section so that
+// other processes can look at the console without scraping it
+// (frames of the context that is current when it's created, which has to
+// outlive it)
+// the section starts with a seqlock-style header: the sequence number is odd
+// while a frame is being written, so readers can detect torn frames and
+// retry instead of ever making the renderer wait for them
+class shared_framebuffer {
+public:
+  // capacity is the largest console size that can be published, bigger
+  // frames are dropped
+  // opening fails if a section with this name already exists and is too
+  // small for capacity
+  explicit shared_framebuffer(wchar_t const* name,
+    vec2 const& capacity = { 512, 256 });
+  ~shared_framebuffer();
+
+  shared_framebuffer(shared_framebuffer const&) = delete;
+  shared_framebuffer& operator=(shared_framebuffer const&) = delete;
+
+  // was the shared memory section successfully created?
+  bool is_open() const;
+
+  // the number of frames that were too big to be published
+  size_t dropped() const;
+
+private:
+  // copy a frame into the shared memory section
+  void publish(CHAR_INFO const* cells, vec2 const& size);
+
+private:
+  HANDLE mapping_ = nullptr;
+  uint8_t* data_ = nullptr;
+
+  // the number of cells that fit in the section, kept here since anyone
+  // with access to the section can change the header
+  size_t capacity_ = 0;
+
+  // the hook is removed from the context it was added to, whichever one is
+  // current when this is destroyed
+  impl::context_state* context_ = nullptr;
+  int hook_ = -1;
+  size_t dropped_ = 0;
+};
+
+// reads frames published by term::shared_framebuffer (usually from another
+// process)
+class shared_framebuffer_reader {
+public:
+  explicit shared_framebuffer_reader(wchar_t const* name);
+  ~shared_framebuffer_reader();
+
+  shared_framebuffer_reader(shared_framebuffer_reader const&) = delete;
+  shared_framebuffer_reader& operator=(shared_framebuffer_reader const&) = delete;
+
+  // was the shared memory section successfully opened?
+  bool is_open() const;
+
+  // look at the latest frame without copying it
+  // fn(cells, size, frame) points straight into shared memory and may be
+  // called more than once if the renderer was writing at the same time, only
+  // the last call is consistent and only if this returns true
+  template <typename Fn>
+  bool read(Fn&& fn, int max_attempts = 64) const;
+
+  // copy the latest frame, returns false if no consistent frame was seen
+  bool snapshot(std::vector<CHAR_INFO>& cells, vec2& size) const;
+
+private:
+  HANDLE mapping_ = nullptr;
+  uint8_t* data_ = nullptr;
+
+  // the number of cells that fit in our view of the section, whatever the
+  // header says
+  size_t capacity_ = 0;
+};
+
+
+//
+//
+// implmentation below
+//
+//
+
+
+namespace impl {
+
+// the start of the shared memory section, the cells follow it
+struct shared_header {
+  uint32_t magic;
+
+  // the maximum number of cells
+  uint32_t capacity;
+
+  // odd while a frame is being written
+  std::atomic<uint32_t> sequence;
+
+  // the size of the current frame
+  uint32_t width, height;
+
+  uint32_t reserved;
+
+  // the number of frames published so far
+  uint64_t frame;
+};
+static_assert(std::atomic<uint32_t>::is_always_lock_free,
+  "the sequence number must be lock-free to be shared between processes");
+
+constexpr uint32_t shared_magic = 0x46535457; // WTSF
+constexpr size_t shared_cells_offset = 64;
+static_assert(sizeof(shared_header) <= shared_cells_offset, "header is too big");
+
+// the number of cells that fit in a mapped view of a section (sections are
+// rounded up to whole pages, so this can be more than was asked for)
+inline size_t shared_view_cells(void const* const view) {
+  MEMORY_BASIC_INFORMATION info;
+  if (!VirtualQuery(view, &info, sizeof(info)) || info.RegionSize < shared_cells_offset)
+    return 0;
+
+  return (info.RegionSize - shared_cells_offset) / sizeof(CHAR_INFO);
+}
+
+} // namespace impl
+
+inline shared_framebuffer::shared_framebuffer(
+    wchar_t const* const name, vec2 const& capacity) {
+  auto const count = (size_t)capacity.x * (size_t)capacity.y;
+  auto const bytes = (uint64_t)(impl::shared_cells_offset + count * sizeof(CHAR_INFO));
+
+  mapping_ = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+    (DWORD)(bytes >> 32), (DWORD)bytes, name);
+
+  if (!mapping_)
+    return;
+
+  // someone else created it first, with whatever size they asked for
+  auto const existed = GetLastError() == ERROR_ALREADY_EXISTS;
+
+  data_ = (uint8_t*)MapViewOfFile(mapping_, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+  if (!data_)
+    return;
+
+  if (existed && impl::shared_view_cells(data_) < count) {
+    UnmapViewOfFile(data_);
+    data_ = nullptr;
+    return;
+  }
+
+  capacity_ = count;
+
+  auto const header = new (data_) impl::shared_header{};
+  header->capacity = (uint32_t)count;
+  header->magic = impl::shared_magic;
+
+  context_ = &impl::state();
+  hook_ = add_flush_hook([this](CHAR_INFO const* const cells, vec2 const& size) {
+    publish(cells, size);
+  });
+}
+
+inline shared_framebuffer::~shared_framebuffer() {
+  if (hook_ != -1)
+    impl::remove_flush_hook(*context_, hook_);
+
+  if (data_)
+    UnmapViewOfFile(data_);
+
+  if (mapping_)
+    CloseHandle(mapping_);
+}
+
+// was the shared memory section successfully created?
+inline bool shared_framebuffer::is_open() const {
+  return data_ != nullptr;
+}
+
+// the number of frames that were too big to be published
+inline size_t shared_framebuffer::dropped() const {
+  return dropped_;
+}
+
+// copy a frame into the shared memory section
+inline void shared_framebuffer::publish(CHAR_INFO const* const cells, vec2 const& size) {
+  auto& header = *(impl::shared_header*)data_;
+  auto const count = (size_t)size.x * (size_t)size.y;
+
+  if (count > capacity_) {
+    dropped_ += 1;
+    return;
+  }
+
+  // mark the frame as being written, readers will retry until we're done
+  auto const sequence = header.sequence.load(std::memory_order_relaxed);
+  header.sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  header.width = (uint32_t)size.x;
+  header.height = (uint32_t)size.y;
+  header.frame += 1;
+  memcpy(data_ + impl::shared_cells_offset, cells, count * sizeof(CHAR_INFO));
+
+  header.sequence.store(sequence + 2, std::memory_order_release);
+}
+
+inline shared_framebuffer_reader::shared_framebuffer_reader(wchar_t const* const name) {
+  mapping_ = OpenFileMappingW(FILE_MAP_READ, FALSE, name);
+  if (!mapping_)
+    return;
+
+  data_ = (uint8_t*)MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+  if (!data_)
+    return;
+
+  // too small to even hold the header, or not a framebuffer at all
+  capacity_ = impl::shared_view_cells(data_);
+
+  if (capacity_ == 0 || ((impl::shared_header const*)data_)->magic != impl::shared_magic) {
+    UnmapViewOfFile(data_);
+    data_ = nullptr;
+  }
+}
+
+inline shared_framebuffer_reader::~shared_framebuffer_reader() {
+  if (data_)
+    UnmapViewOfFile(data_);
+
+  if (mapping_)
+    CloseHandle(mapping_);
+}
+
+// was the shared memory section successfully opened?
+inline bool shared_framebuffer_reader::is_open() const {
+  return data_ != nullptr;
+}
+
+// look at the latest frame without copying it
+template <typename Fn>
+inline bool shared_framebuffer_reader::read(Fn&& fn, int const max_attempts) const {
+  if (!data_)
+    return false;
+
+  auto& header = *(impl::shared_header*)data_;
+  auto const cells = (CHAR_INFO const*)(data_ + impl::shared_cells_offset);
+
+  for (int attempt = 0; attempt < max_attempts; ++attempt) {
+    auto const sequence = header.sequence.load(std::memory_order_acquire);
+
+    // nothing published yet
+    if (sequence == 0)
+      return false;
+
+    // the renderer is in the middle of writing a frame
+    if (sequence & 1) {
+      std::this_thread::yield();
+      continue;
+    }
+
+    auto const width = header.width, height = header.height;
+    auto const frame = header.frame;
+
+    // a torn (or hostile) header could point anywhere, the frame has to fit
+    // in what the header claims and in what we actually mapped
+    auto const capacity = (std::min)((size_t)header.capacity, capacity_);
+
+    auto const fits = width <= capacity && height <= capacity &&
+      (uint64_t)width * height <= capacity;
+
+    if (fits)
+      fn(cells, vec2{ (int)width, (int)height }, frame);
+
+    // a consistent header that doesn't fit is corrupt, not torn
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (header.sequence.load(std::memory_order_relaxed) == sequence)
+      return fits;
+  }
+
+  return false;
+}
+
+// copy the latest frame, returns false if no consistent frame was seen
+inline bool shared_framebuffer_reader::snapshot(
+    std::vector<CHAR_INFO>& cells, vec2& size) const {
+  return read([&](CHAR_INFO const* const src, vec2 const& s, uint64_t) {
+    cells.assign(src, src + (size_t)s.x * (size_t)s.y);
+    size = s;
+  });
+}
+
+} // namespace term
@@ -0,0 +1,292 @@
+#pragma once
+
+#include "winterm_box.h"
+
+
+namespace term {
+
+// a scrollable table that can hold any number of rows
+// the rows aren't stored anywhere, the text of a cell is requested from a
+// formatter only when it becomes visible and is then cached until the row is
+// invalidated, so drawing costs the same for ten rows as for ten million
+class table {
+public:
+  struct column {
+    std::wstring title;
+
+    // measured in characters, not including the separators
+    int width;
+  };
+
+  // append the text of a single cell to out (color codes are allowed)
+  using formatter = std::function<void(size_t row, size_t column, std::wstring& out)>;
+
+  table(std::vector<column> columns, formatter format);
+
+  // the number of rows in the table
+  void rows(size_t count);
+  size_t rows() const;
+
+  // the text of a row changed, it'll be formatted again the next time it's drawn
+  void invalidate(size_t row);
+
+  // the text of every row changed
+  void invalidate();
+
+  // scroll by a number of rows (negative scrolls up)
+  void scroll(ptrdiff_t rows);
+
+  // scroll so that row is the first visible one (as far as possible)
+  void scroll_to(size_t row);
+
+  // the first visible row
+  size_t first_row() const;
+
+  // scroll horizontally so that column index is the first visible one
+  void first_column(size_t index);
+  size_t first_column() const;
+
+  // draw the table with a border around it, the header takes up 2 rows
+  void draw(rect const& area, attribute text, attribute header, attribute border);
+
+  // the number of cells that had to be formatted (that weren't cached)
+  size_t formatted() const;
+
+private:
+  // the cached text of a row
+  struct cached_row {
+    // which row is cached, the version it was formatted at and which of its
+    // columns were formatted (only visible columns ever are)
+    size_t row = SIZE_MAX;
+    uint64_t version = 0;
+    std::vector<uint8_t> ready;
+
+    std::vector<std::wstring> cells;
+  };
+
+  // the text of a cell, formatting it if it isn't cached
+  std::wstring_view cell(size_t row, size_t col);
+
+  // the number of rows that fit in the table, as of the last draw
+  size_t visible_rows() const;
+
+  // keep the first visible row in range
+  void clamp();
+
+private:
+  std::vector<column> columns_;
+  formatter format_;
+
+  size_t rows_ = 0;
+  size_t first_row_ = 0, first_column_ = 0;
+  int body_height_ = 0;
+
+  // direct mapped by row, at least twice the number of visible rows so that
+  // scrolling a page keeps the rows that are still visible
+  std::vector<cached_row> cache_;
+  uint64_t version_ = 1;
+
+  size_t formatted_ = 0;
+
+  // reused between draws
+  std::vector<int> widths_, heights_;
+  std::vector<CHAR_INFO> clipped_;
+};
+
+
+//
+//
+// implmentation below
+//
+//
+
+
+inline table::table(std::vector<column> columns, formatter format)
+  : columns_(std::move(columns)), format_(std::move(format)) {}
+
+// the number of rows in the table
+inline void table::rows(size_t const count) {
+  rows_ = count;
+  clamp();
+}
+
+// the number of rows in the table
+inline size_t table::rows() const {
+  return rows_;
+}
+
+// the text of a row changed
+inline void table::invalidate(size_t const row) {
+  if (cache_.empty())
+    return;
+
+  auto& entry = cache_[row % cache_.size()];
+  if (entry.row == row)
+    entry.row = SIZE_MAX;
+}
+
+// the text of every row changed
+inline void table::invalidate() {
+  version_ += 1;
+}
+
+// scroll by a number of rows
+inline void table::scroll(ptrdiff_t const rows) {
+  if (rows < 0 && (size_t)-rows > first_row_)
+    first_row_ = 0;
+  else
+    first_row_ += rows;
+
+  clamp();
+}
+
+// scroll so that row is the first visible one
+inline void table::scroll_to(size_t const row) {
+  first_row_ = row;
+  clamp();
+}
+
+// the first visible row
+inline size_t table::first_row() const {
+  return first_row_;
+}
+
+// scroll horizontally so that column index is the first visible one
+inline void table::first_column(size_t const index) {
+  first_column_ = columns_.empty() ? 0 : (std::min)(index, columns_.size() - 1);
+}
+
+// the first visible column
+inline size_t table::first_column() const {
+  return first_column_;
+}
+
+// draw the table with a border around it
+inline void table::draw(rect const& area, attribute const text,
+    attribute const header, attribute const border) {
+  // the border, header and the ruling below it
+  body_height_ = (std::max)(0, area.height - 4);
+  clamp();
+
+  // direct mapped by row, so the size only has to change with the height
+  auto const capacity = (size_t)(std::max)(1, body_height_ * 2);
+  if (cache_.size() != capacity) {
+    cache_.clear();
+    cache_.resize(capacity);
+  }
+
+  // only the columns that fit completely
+  widths_.clear();
+
+  auto used = 1;
+
+  for (auto c = first_column_; c < columns_.size(); ++c) {
+    if (used + columns_[c].width + 1 > area.width)
+      break;
+
+    widths_.push_back(columns_[c].width);
+    used += columns_[c].width + 1;
+  }
+
+  if (widths_.empty() || area.height < 4)
+    return;
+
+  auto const console = impl::state().size;
+  auto const rows = (int)(std::min)((size_t)body_height_, rows_ - first_row_);
+
+  // write a cell, padding the rest of its width with spaces
+  auto const write = [&](vec2 const& position, int const width,
+      attribute const attrib, std::wstring_view const str) {
+    if (position.y < 0 || position.y >= console.y)
+      return;
+
+    // clip to the console
+    auto const first = (std::max)(0, position.x);
+    auto const last = (std::min)(console.x, position.x + width);
+
+    if (first >= last)
+      return;
+
+    auto const row = &impl::state().backbuffer[(size_t)position.y * console.x];
+
+    // color codes can't be skipped without laying them out, so cells that
+    // hang off the left edge are laid out somewhere else first
+    if (first != position.x)
+      clipped_.resize((size_t)(last - position.x));
+
+    auto const dst = first == position.x ? row + first : clipped_.data();
+    auto const written = (int)impl::layout(str, attrib,
+      dst, (size_t)(last - position.x), false).first;
+
+    if (dst != row + first) {
+      auto const skip = first - position.x;
+      if (written > skip)
+        memcpy(row + first, dst + skip, (size_t)(written - skip) * sizeof(CHAR_INFO));
+    }
+
+    std::fill(row + (std::max)(first, position.x + written), row + last,
+      CHAR_INFO{ L' ', attrib.value });
+  };
+
+  for (int c = 0, x = area.x + 1; c < (int)widths_.size(); ++c) {
+    write({ x, area.y + 1 }, widths_[c], header, columns_[first_column_ + c].title);
+
+    for (int r = 0; r < rows; ++r) {
+      write({ x, area.y + 3 + r }, widths_[c], text,
+        cell(first_row_ + r, first_column_ + c));
+    }
+
+    // rows past the end of the table
+    for (int r = rows; r < body_height_; ++r)
+      write({ x, area.y + 3 + r }, widths_[c], text, {});
+
+    x += widths_[c] + 1;
+  }
+
+  heights_.assign({ 1, body_height_ });
+  grid({ area.x, area.y }, widths_, heights_, border);
+}
+
+// the number of cells that had to be formatted
+inline size_t table::formatted() const {
+  return formatted_;
+}
+
+// the text of a cell, formatting it if it isn't cached
+inline std::wstring_view table::cell(size_t const row, size_t const col) {
+  auto& entry = cache_[row % cache_.size()];
+
+  // a different row (or an outdated version of this one) used this slot,
+  // the strings are kept so their memory gets reused
+  if (entry.row != row || entry.version != version_) {
+    entry.row = row;
+    entry.version = version_;
+    entry.ready.assign(columns_.size(), 0);
+    entry.cells.resize(columns_.size());
+  }
+
+  auto& str = entry.cells[col];
+
+  if (!entry.ready[col]) {
+    str.clear();
+    format_(row, col, str);
+
+    entry.ready[col] = 1;
+    formatted_ += 1;
+  }
+
+  return str;
+}
+
+// the number of rows that fit in the table
+inline size_t table::visible_rows() const {
+  return (size_t)body_height_;
+}
+
+// keep the first visible row in range
+inline void table::clamp() {
+  auto const visible = visible_rows();
+  first_row_ = (std::min)(first_row_, rows_ > visible ? rows_ - visible : 0);
+}
+
+} // namespace term
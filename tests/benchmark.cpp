@@ -0,0 +1,322 @@
+// times the hot paths that were optimized, against straightforward versions
+// of them, so the numbers quoted in the history can be checked on any machine
+// (they were measured on a 600x200 buffer, same as below)
+//
+// cl /std:c++17 /O2 /EHsc /I..\include benchmark.cpp
+
+#include <winterm.h>
+#include <winterm_image.h>
+#include <winterm_record.h>
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <thread>
+
+
+namespace {
+
+constexpr term::vec2 size = { 600, 200 };
+constexpr auto count = (size_t)size.x * size.y;
+
+// average microseconds per call
+template <typename Fn>
+double measure(int const iterations, Fn&& fn) {
+  auto const start = std::chrono::steady_clock::now();
+
+  for (int i = 0; i < iterations; ++i)
+    fn(i);
+
+  return std::chrono::duration<double, std::micro>(
+    std::chrono::steady_clock::now() - start).count() / iterations;
+}
+
+// push a buffer out of the cache, like a frame that was presented a while ago
+void evict() {
+  static std::vector<uint8_t> junk(64 * 1024 * 1024);
+
+  for (size_t i = 0; i < junk.size(); i += 64)
+    junk[i] += 1;
+}
+
+// the diff one cell at a time
+void diff_scalar(CHAR_INFO const* const previous, CHAR_INFO const* const cells,
+    std::vector<term::impl::span>& spans) {
+  constexpr int max_gap = 4;
+  spans.clear();
+
+  for (int y = 0; y < size.y; ++y) {
+    auto const row = (size_t)y * size.x;
+
+    for (int x = 0; x < size.x; ++x) {
+      if (term::impl::cell_bits(cells[row + x]) == term::impl::cell_bits(previous[row + x]))
+        continue;
+
+      if (!spans.empty() && spans.back().y == y && x - spans.back().last <= max_gap)
+        spans.back().last = x + 1;
+      else
+        spans.push_back({ y, x, x + 1 });
+    }
+  }
+}
+
+// fill() the way it used to be, looking the context up for every cell
+void fill_per_cell(term::attribute const attrib, wchar_t const c) {
+  for (size_t i = 0; i <
+      (size_t)term::impl::state().size.x * (size_t)term::impl::state().size.y; ++i) {
+    term::impl::state().backbuffer[i] = { c, attrib.value };
+  }
+}
+
+// fill() and hline() against writing every cell on its own
+void drawing() {
+  term::context ctx(size);
+  term::context_scope const scope(ctx);
+
+  auto const per_cell = measure(2000, [](int const i) {
+    fill_per_cell({ (uint16_t)(i & 15), term::black }, L'x');
+  });
+
+  auto const fill = measure(2000, [](int const i) {
+    term::fill({ (uint16_t)(i & 15), term::black }, L'x');
+  });
+
+  auto const hline = measure(2000, [](int const i) {
+    for (int y = 0; y < size.y; ++y)
+      term::hline(y, { (uint16_t)(i & 15), term::black }, L'-');
+  });
+
+  printf("drawing: per cell %.1f us, fill %.1f us, hline %.1f us (per frame)\n",
+    per_cell, fill, hline);
+}
+
+// utf-8 strings laid out directly, against widening them first
+void strings() {
+  term::context ctx(size);
+  term::context_scope const scope(ctx);
+
+  std::string const line(size.x, 'x');
+
+  auto const widened = measure(2000, [&](int const i) {
+    std::wstring const wide(begin(line), end(line));
+    term::string({ 0, i % size.y }, term::white, std::wstring_view(wide));
+  });
+
+  auto const utf8 = measure(2000, [&](int const i) {
+    term::string({ 0, i % size.y }, term::white, std::string_view(line));
+  });
+
+  printf("strings: widened %.2f us, utf-8 %.2f us (per %d character line)\n",
+    widened, utf8, size.x);
+}
+
+// flushing with a recorder attached, with a few hundred cells changing
+// every frame and a keyframe every 300 frames
+void recording() {
+  term::context ctx(size);
+  term::context_scope const scope(ctx);
+
+  std::mt19937 rng(1);
+  auto const cells = term::impl::state().backbuffer.get();
+
+  auto const frame = [&](int) {
+    for (int i = 0; i < 300; ++i)
+      cells[rng() % count] = { (wchar_t)(L'a' + rng() % 26), (WORD)(rng() % 16) };
+
+    term::flush();
+  };
+
+  auto const plain = measure(1000, frame);
+
+  auto const path = std::filesystem::temp_directory_path() / "winterm_benchmark.rec";
+  double recorded = 0.0;
+  size_t bytes = 0;
+
+  {
+    term::recorder recorder(path);
+    recorded = measure(1000, frame);
+    bytes = recorder.stats().bytes;
+  }
+
+  std::filesystem::remove(path);
+
+  printf("recording: flush %.1f us, flush and record %.1f us, %zu bytes per frame\n",
+    plain, recorded, bytes / 1000);
+}
+
+// a 320x200 image quantized with a bayer matrix and with error diffusion,
+// cold (the first image on a thread, which asks the console for its palette
+// and builds the lookup table) and with the palette and table cached
+void images() {
+  constexpr term::vec2 image_size = { 320, 200 };
+  constexpr term::vec2 cells = { 320, 100 };
+
+  term::context ctx(cells);
+
+  std::mt19937 rng(1);
+  std::vector<uint8_t> rgb((size_t)image_size.x * image_size.y * 3);
+
+  // a gradient with some noise, so neither dithering mode has it easy
+  for (int y = 0; y < image_size.y; ++y) {
+    for (int x = 0; x < image_size.x; ++x) {
+      auto const pixel = &rgb[((size_t)y * image_size.x + x) * 3];
+      pixel[0] = (uint8_t)(x * 255 / image_size.x);
+      pixel[1] = (uint8_t)(y * 255 / image_size.y);
+      pixel[2] = (uint8_t)(rng() % 256);
+    }
+  }
+
+  auto const draw = [&](term::dithering const mode, unsigned const threads) {
+    term::image({ 0, 0 }, cells, rgb.data(), image_size,
+      (size_t)image_size.x * 3, mode, threads);
+  };
+
+  // the caches are per thread, so every cold call gets a new one (only the
+  // call itself is timed)
+  auto const cold = [&](term::dithering const mode) {
+    double total = 0.0;
+
+    for (int i = 0; i < 20; ++i) {
+      std::thread([&] {
+        term::context_scope const scope(ctx);
+        total += measure(1, [&](int) { draw(mode, 1); });
+      }).join();
+    }
+
+    return total / 20;
+  };
+
+  auto const cached = [&](term::dithering const mode, unsigned const threads) {
+    term::context_scope const scope(ctx);
+    draw(mode, threads);
+
+    return measure(200, [&](int) { draw(mode, threads); });
+  };
+
+  auto const threads = (std::max)(std::thread::hardware_concurrency(), 1u);
+
+  printf("image bayer: cold %.1f us, cached %.1f us, cached on %u threads %.1f us\n",
+    cold(term::dither_ordered), cached(term::dither_ordered, 1),
+    threads, cached(term::dither_ordered, threads));
+
+  printf("image floyd-steinberg: cold %.1f us, cached %.1f us\n",
+    cold(term::dither_diffusion), cached(term::dither_diffusion, 1));
+}
+
+// the row diff, one cell at a time and with sse2
+void diffing() {
+  std::mt19937 rng(1);
+  std::vector<CHAR_INFO> previous(count), cells(count);
+  std::vector<term::impl::span> spans;
+
+  for (auto const changed : { 0.0005, 0.05, 0.5 }) {
+    cells = previous;
+    for (auto& cell : cells) {
+      if (rng() % 100000 < changed * 100000)
+        cell.Attributes ^= 1;
+    }
+
+    auto const scalar = measure(500, [&](int) {
+      diff_scalar(previous.data(), cells.data(), spans);
+    });
+
+    auto const simd = measure(500, [&](int) {
+      term::impl::diff_spans(previous.data(), cells.data(), size, spans);
+    });
+
+    printf("diff with %.2f%% changed: scalar %.1f us, diff_spans %.1f us\n",
+      changed * 100, scalar, simd);
+  }
+}
+
+// hashing rows against comparing their cells, with the previous frame in
+// and out of the cache
+void hashing() {
+  std::vector<CHAR_INFO> previous(count), cells(count);
+  std::vector<term::impl::span> spans;
+
+  for (size_t i = 0; i < count; ++i)
+    previous[i] = cells[i] = { (wchar_t)(i * 7), (WORD)i };
+
+  uint64_t sink = 0;
+
+  auto const hash = measure(200, [&](int) {
+    for (int y = 0; y < size.y; ++y)
+      sink += term::impl::hash_row(cells.data() + (size_t)y * size.x, size.x);
+  });
+
+  auto const compare = measure(200, [&](int) {
+    term::impl::diff_spans(previous.data(), cells.data(), size, spans);
+  });
+
+  // evicting takes far longer than what is being timed, so only the
+  // timed part is added up
+  double hash_cold = 0.0, compare_cold = 0.0;
+
+  for (int i = 0; i < 50; ++i) {
+    evict();
+    hash_cold += measure(1, [&](int) {
+      for (int y = 0; y < size.y; ++y)
+        sink += term::impl::hash_row(cells.data() + (size_t)y * size.x, size.x);
+    });
+
+    evict();
+    compare_cold += measure(1, [&](int) {
+      term::impl::diff_spans(previous.data(), cells.data(), size, spans);
+    });
+  }
+
+  printf("unchanged frame, cached: hash %.1f us, compare %.1f us\n", hash, compare);
+  printf("unchanged frame, cold: hash %.1f us, compare %.1f us (%llu)\n",
+    hash_cold / 50, compare_cold / 50, (unsigned long long)(sink & 1));
+}
+
+// whole vt presents with the diff on one thread and on all of them, written
+// to the null device so only the work before the write is timed
+void presenting() {
+  auto const out = CreateFileW(L"NUL", GENERIC_WRITE, 0,
+    nullptr, OPEN_EXISTING, 0, nullptr);
+  if (out == INVALID_HANDLE_VALUE)
+    return;
+
+  term::context ctx(out, nullptr, size);
+  term::context_scope const scope(ctx);
+  term::enable(term::vt_output);
+
+  std::mt19937 rng(1);
+  auto const cells = term::impl::state().backbuffer.get();
+
+  auto const frame = [&](int) {
+    // a few hundred cells change every frame
+    for (int i = 0; i < 300; ++i)
+      cells[rng() % count] = { (wchar_t)(L'a' + rng() % 26), (WORD)(rng() % 16) };
+
+    term::flush();
+  };
+
+  auto const threads = (std::max)(std::thread::hardware_concurrency(), 1u);
+
+  term::diff_threads(1);
+  auto const single = measure(500, frame);
+
+  term::diff_threads(threads);
+  auto const banded = measure(500, frame);
+
+  printf("present: 1 diff thread %.1f us, %u diff threads %.1f us\n",
+    single, threads, banded);
+
+  CloseHandle(out);
+}
+
+} // namespace
+
+int main() {
+  drawing();
+  strings();
+  recording();
+  images();
+  diffing();
+  hashing();
+  presenting();
+}
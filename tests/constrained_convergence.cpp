@@ -0,0 +1,69 @@
+// an idle screen has to stop being written once bandwidth_aware output has
+// caught up, including cells that went out with their colors reduced
+//
+// cl /std:c++17 /EHsc /I..\include constrained_convergence.cpp
+// exits with 0 if it converged
+
+#include <winterm.h>
+
+#include <cstdio>
+#include <string>
+
+
+int main() {
+  // the output goes nowhere, the bandwidth limit is what constrains it
+  auto const out = CreateFileW(L"NUL", GENERIC_WRITE, 0,
+    nullptr, OPEN_EXISTING, 0, nullptr);
+  if (out == INVALID_HANDLE_VALUE)
+    return 1;
+
+  term::context ctx(out, nullptr, { 80, 25 });
+  term::context_scope const scope(ctx);
+
+  term::enable(term::vt_output);
+  term::enable(term::bandwidth_aware);
+  term::bandwidth_limit(20000);
+
+  // the frame interval starts out long, so the first frames aren't constrained
+  for (int i = 0; i < 30; ++i) {
+    term::clear();
+    term::string({ 0, 0 }, term::white, std::string_view("warming up " + std::to_string(i)));
+
+    Sleep(16);
+    term::flush();
+  }
+
+  // a full screen of intense colors at once, far more than a frame's budget
+  term::clear();
+  for (int y = 0; y < term::size().y; ++y) {
+    term::string({ 0, y }, { term::white | term::intense, term::blue | term::intense },
+      std::string_view("a log line with an intense background " + std::to_string(y)));
+  }
+
+  // nothing changes from here on, so the output has to stop at some point
+  auto last = term::vt_output_stats().bytes;
+  int idle_frames = 0, frame = 0;
+
+  for (; frame < 400 && idle_frames < 10; ++frame) {
+    Sleep(16);
+    term::flush();
+
+    auto const bytes = term::vt_output_stats().bytes;
+    idle_frames = bytes == last ? idle_frames + 1 : 0;
+    last = bytes;
+  }
+
+  auto const stats = term::vt_output_stats();
+  auto const reduced = term::impl::state().reduced_cells;
+
+  printf("frames %d, constrained %zu, deferred %zu, still reduced %zu\n",
+    frame, stats.constrained_frames, stats.deferred_spans, reduced);
+
+  CloseHandle(out);
+
+  // it has to have been constrained for this to test anything
+  if (stats.constrained_frames == 0)
+    return 1;
+
+  return idle_frames >= 10 && reduced == 0 ? 0 : 1;
+}
@@ -0,0 +1,69 @@
+// a frame pacer has to keep flushing after the app stops drawing until
+// bandwidth_aware output has written everything it put off or reduced
+//
+// cl /std:c++17 /EHsc /I..\include pacer_convergence.cpp
+// exits with 0 if it converged
+
+#include <winterm.h>
+#include <winterm_pacing.h>
+
+#include <cstdio>
+#include <string>
+
+
+int main() {
+  // the output goes nowhere, the bandwidth limit is what constrains it
+  auto const out = CreateFileW(L"NUL", GENERIC_WRITE, 0,
+    nullptr, OPEN_EXISTING, 0, nullptr);
+  if (out == INVALID_HANDLE_VALUE)
+    return 1;
+
+  term::context ctx(out, nullptr, { 80, 25 });
+  term::context_scope const scope(ctx);
+
+  term::enable(term::vt_output);
+  term::enable(term::bandwidth_aware);
+  term::bandwidth_limit(20000);
+
+  term::frame_pacer pacer(60.0, 60.0);
+
+  // the frame interval starts out long, so the first frames aren't constrained
+  for (int i = 0; i < 30; ++i) {
+    term::clear();
+    term::string({ 0, 0 }, term::white, std::string_view("warming up " + std::to_string(i)));
+    pacer.present();
+  }
+
+  // a burst that is far more than a frame's budget, then nothing is drawn
+  term::clear();
+  for (int y = 0; y < term::size().y; ++y) {
+    term::string({ 0, y }, { term::white | term::intense, term::blue | term::intense },
+      std::string_view("a log line with an intense background " + std::to_string(y)));
+  }
+
+  auto const constrained = term::vt_output_stats().constrained_frames;
+
+  for (int i = 0; i < 400 && pacer.stats().idle < 10; ++i)
+    pacer.present();
+
+  auto const stats = term::vt_output_stats();
+  auto const& s = term::impl::state();
+
+  // what the terminal was sent has to be the whole backbuffer, at full color
+  auto const count = (size_t)s.size.x * (size_t)s.size.y;
+  auto const matches = s.presented.size() == count && memcmp(s.presented.data(),
+    s.backbuffer.get(), count * sizeof(CHAR_INFO)) == 0;
+
+  printf("constrained %zu, idle %zu, still reduced %zu, presented %s\n",
+    stats.constrained_frames - constrained, pacer.stats().idle,
+    s.reduced_cells, matches ? "matches" : "differs");
+
+  CloseHandle(out);
+
+  // it has to have been constrained for this to test anything
+  if (stats.constrained_frames == constrained)
+    return 1;
+
+  return pacer.stats().idle >= 10 && s.reduced_cells == 0 && matches &&
+    !term::needs_flush() ? 0 : 1;
+}